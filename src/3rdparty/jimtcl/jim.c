@@ -615,19 +615,35 @@ static void JimPanicDump(int condition, const char *fmt, ...)
  * Memory allocation
  * ---------------------------------------------------------------------------*/
 
+static void *JimDefaultAllocator(void *ptr, size_t size)
+{
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    else if (ptr) {
+        return realloc(ptr, size);
+    }
+    else {
+        return malloc(size);
+    }
+}
+
+void *(*Jim_Allocator)(void *ptr, size_t size) = JimDefaultAllocator;
+
 void *Jim_Alloc(int size)
 {
-    return size ? malloc(size) : NULL;
+    return size ? Jim_Allocator(NULL, size) : NULL;
 }
 
 void Jim_Free(void *ptr)
 {
-    free(ptr);
+    Jim_Allocator(ptr, 0);
 }
 
 void *Jim_Realloc(void *ptr, int size)
 {
-    return realloc(ptr, size);
+    return Jim_Allocator(ptr, size);
 }
 
 char *Jim_StrDup(const char *s)
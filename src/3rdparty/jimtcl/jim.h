@@ -605,6 +605,10 @@ JIM_EXPORT void Jim_Free(void *ptr);
 JIM_EXPORT char * Jim_StrDup(const char *s);
 JIM_EXPORT char * Jim_StrDupLen(const char *s, int l);
 
+/* All allocations made through Jim_Alloc, Jim_Realloc and Jim_Free go through this
+ * function. A size of 0 frees ptr, otherwise ptr is reallocated (or allocated if NULL). */
+JIM_EXPORT extern void *(*Jim_Allocator)(void *ptr, size_t size);
+
 /* environment */
 JIM_EXPORT char ** Jim_GetEnviron(void);
 JIM_EXPORT void Jim_SetEnviron(char **env);
@@ -0,0 +1,76 @@
+
+#include "Aggregate.h"
+#include "ValueStore.h"
+#include "Document.h"
+#include "RangeTree.h"
+
+#include <algorithm>
+#include <vector>
+
+// Cells in the column that are not evaluated yet are evaluated first
+static bool summarizeColumn(ValueStore const& store, int x, int y0, int y1, RangeSummary & summary)
+{
+  if (store.summarize(x, y0, y1, summary))
+    return true;
+
+  if (!store.valid())
+    return false;
+
+  const int count = y1 - y0 + 1;
+  for (int row = store.findPending(x, y0, count); row >= 0; row = store.findPending(x, row + 1, y0 + count - row - 1))
+    doc::getCellValue(Index(x, row));
+
+  return store.summarize(x, y0, y1, summary);
+}
+
+double aggregateRange(Aggregate aggregate, Index const& start, Index const& end)
+{
+  ValueStore const& store = doc::values();
+  const int count = end.y - start.y + 1;
+
+  RangeSummary totals;
+
+  for (int x = start.x; x <= end.x; ++x)
+  {
+    RangeSummary column;
+
+    if (!summarizeColumn(store, x, start.y, end.y, column))
+    {
+      // Without an up to date store every cell is read through the document
+      thread_local std::vector<double> columnValues;
+      thread_local std::vector<uint8_t> columnNumbers;
+
+      columnValues.assign(count, 0.0);
+      columnNumbers.assign(count, 0);
+
+      doc::forEachCellValue(Index(x, start.y), Index(x, end.y), [&start](Index const& idx, double value, bool number) {
+        columnValues[idx.y - start.y] = value;
+        columnNumbers[idx.y - start.y] = number ? 1 : 0;
+      });
+
+      column = RangeTree().query(columnValues.data(), columnNumbers.data(), start.y, end.y + 1, start.y, end.y);
+    }
+
+    totals = combine(totals, column);
+  }
+
+  switch (aggregate)
+  {
+    case Aggregate::Sum:
+      return totals.sum;
+
+    case Aggregate::Min:
+      return totals.count > 0 ? totals.min : 0.0;
+
+    case Aggregate::Max:
+      return totals.count > 0 ? totals.max : 0.0;
+
+    case Aggregate::Average:
+      return totals.count > 0 ? totals.sum / totals.count : 0.0;
+
+    case Aggregate::Count:
+      return totals.count;
+  }
+
+  return 0.0;
+}
@@ -0,0 +1,21 @@
+
+#pragma once
+
+#include "Index.h"
+
+#include <cstdint>
+
+// Reductions over a range of cells. Ranges are summarized a column at a time from the range
+// trees of the document value store, and the cells are always combined in the same order, so
+// a range gives exactly the same result whichever evaluator asks for it. Only cells holding numbers count
+// towards MIN, MAX, AVERAGE and COUNT, a range without numbers gives 0.
+enum class Aggregate : uint8_t
+{
+  Sum,
+  Min,
+  Max,
+  Average,
+  Count
+};
+
+double aggregateRange(Aggregate aggregate, Index const& start, Index const& end);
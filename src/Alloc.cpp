@@ -0,0 +1,182 @@
+
+#include "Alloc.h"
+#include "Tcl.h"
+
+#include <bx/mutex.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+namespace alloc {
+
+  static thread_local uint64_t count_ = 0;
+  static thread_local uint64_t bytes_ = 0;
+  static thread_local int depth_ = 0;
+
+  struct Operation
+  {
+    const char * name;
+    uint64_t calls;
+    Counters counters;
+  };
+
+  static bx::Mutex & operationsMutex()
+  {
+    static bx::Mutex mutex;
+    return mutex;
+  }
+
+  static std::vector<Operation> & operations()
+  {
+    static std::vector<Operation> operations;
+    return operations;
+  }
+
+  Counters threadCounters()
+  {
+    Counters counters;
+    counters.count = count_;
+    counters.bytes = bytes_;
+    return counters;
+  }
+
+  void countAllocation(std::size_t size)
+  {
+    count_++;
+    bytes_ += size;
+  }
+
+  Scope::Scope(const char * name)
+    : name_(name),
+      start_(threadCounters()),
+      outermost_(depth_ == 0)
+  {
+    depth_++;
+  }
+
+  Scope::~Scope()
+  {
+    depth_--;
+
+    if (!outermost_)
+      return;
+
+    const Counters end = threadCounters();
+
+    bx::MutexScope lock(operationsMutex());
+
+    Operation * operation = nullptr;
+    for (auto & it : operations())
+    {
+      if (it.name == name_ || strcmp(it.name, name_) == 0)
+      {
+        operation = &it;
+        break;
+      }
+    }
+
+    if (!operation)
+    {
+      operations().push_back({ name_, 0, Counters() });
+      operation = &operations().back();
+    }
+
+    operation->calls++;
+    operation->counters.count += end.count - start_.count;
+    operation->counters.bytes += end.bytes - start_.bytes;
+  }
+
+#if ZUM_ALLOC_TRACKING
+
+  static void * jimAllocator(void * ptr, size_t size)
+  {
+    if (size == 0)
+    {
+      free(ptr);
+      return nullptr;
+    }
+
+    countAllocation(size);
+    return ptr ? realloc(ptr, size) : malloc(size);
+  }
+
+  static void appendCounters(Jim_Interp * interp, Jim_Obj * dict, const char * name, uint64_t calls, Counters const& counters)
+  {
+    Jim_Obj * values = Jim_NewListObj(interp, nullptr, 0);
+    Jim_ListAppendElement(interp, values, Jim_NewStringObj(interp, "calls", -1));
+    Jim_ListAppendElement(interp, values, Jim_NewIntObj(interp, calls));
+    Jim_ListAppendElement(interp, values, Jim_NewStringObj(interp, "count", -1));
+    Jim_ListAppendElement(interp, values, Jim_NewIntObj(interp, counters.count));
+    Jim_ListAppendElement(interp, values, Jim_NewStringObj(interp, "bytes", -1));
+    Jim_ListAppendElement(interp, values, Jim_NewIntObj(interp, counters.bytes));
+
+    Jim_ListAppendElement(interp, dict, Jim_NewStringObj(interp, name, -1));
+    Jim_ListAppendElement(interp, dict, values);
+  }
+
+#endif
+
+  TCL_FUNC(allocStats, "?-reset?", "Returns allocation counts and bytes for each top level operation as a dict")
+  {
+    TCL_CHECK_ARGS(1, 2);
+
+    const bool reset = argc == 2;
+    if (reset && std::string(Jim_String(argv[1])) != "-reset")
+    {
+      Jim_WrongNumArgs(interp, 1, argv, "?-reset?");
+      return JIM_ERR;
+    }
+
+#if ZUM_ALLOC_TRACKING
+
+    // Copy the table first, so allocations made while building the result are not counted while holding the lock
+    std::vector<Operation> copy;
+    {
+      bx::MutexScope lock(operationsMutex());
+      copy = operations();
+
+      if (reset)
+        operations().clear();
+    }
+
+    Jim_Obj * dict = Jim_NewListObj(interp, nullptr, 0);
+    for (auto const& operation : copy)
+      appendCounters(interp, dict, operation.name, operation.calls, operation.counters);
+
+    // Everything allocated on this thread, including allocations made outside of any scope
+    appendCounters(interp, dict, "total", 1, threadCounters());
+
+    Jim_SetResult(interp, dict);
+    return JIM_OK;
+#else
+    Jim_SetResultString(interp, "allocation tracking is not enabled in this build, configure with -DEnableAllocTracking=ON", -1);
+    return JIM_ERR;
+#endif
+  }
+}
+
+#if ZUM_ALLOC_TRACKING
+
+// Installs the Jim allocator before any interpreter is created
+static const bool jimAllocatorInstalled_ = (Jim_Allocator = alloc::jimAllocator, true);
+
+void * operator new(std::size_t size)
+{
+  alloc::countAllocation(size);
+
+  void * ptr = malloc(size > 0 ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void operator delete(void * ptr) noexcept
+{
+  free(ptr);
+}
+
+#endif
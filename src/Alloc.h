@@ -0,0 +1,44 @@
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Allocation accounting, compiled in when the build defines ZUM_ALLOC_TRACKING. Every
+// allocation made through operator new or Jim's allocator is counted, and attributed to
+// the outermost ALLOC_SCOPE active on the thread. Totals are returned by 'allocStats'.
+
+namespace alloc {
+
+  struct Counters
+  {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+  };
+
+  // All allocations made on the calling thread so far
+  Counters threadCounters();
+
+  void countAllocation(std::size_t size);
+
+  class Scope
+  {
+    public:
+      Scope(const char * name);
+      ~Scope();
+
+    private:
+      const char * name_;
+      Counters start_;
+      bool outermost_;
+  };
+}
+
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+
+#if ZUM_ALLOC_TRACKING
+  #define ALLOC_SCOPE(name) alloc::Scope ALLOC_CONCAT(allocScope_, __LINE__)(name)
+#else
+  #define ALLOC_SCOPE(name)
+#endif
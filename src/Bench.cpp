@@ -0,0 +1,196 @@
+
+#include "Bench.h"
+#include "Perf.h"
+#include "Alloc.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
+
+// With allocation tracking enabled the counting hooks are provided by Alloc.cpp
+#if !ZUM_ALLOC_TRACKING
+
+static uint64_t allocations_ = 0;
+
+void * operator new(std::size_t size)
+{
+  allocations_++;
+
+  void * ptr = malloc(size > 0 ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void operator delete(void * ptr) noexcept
+{
+  free(ptr);
+}
+
+#endif
+
+namespace bench {
+
+  uint64_t allocationCount()
+  {
+#if ZUM_ALLOC_TRACKING
+    return alloc::threadCounters().count;
+#else
+    return allocations_;
+#endif
+  }
+
+  Suite::Suite(std::string const& name)
+    : name_(name)
+  { }
+
+  void Suite::run(std::string const& name, int iterations, std::function<void()> const& func,
+                  std::function<void()> const& setup)
+  {
+    std::vector<double> times;
+    times.reserve(iterations);
+
+    uint64_t allocations = 0;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+      if (setup)
+        setup();
+
+      const uint64_t allocationStart = allocationCount();
+      const int64_t start = perf::now();
+      func();
+      times.push_back(perf::elapsed(start));
+      allocations += allocationCount() - allocationStart;
+    }
+
+    add(name, times, allocations);
+  }
+
+  void Suite::add(std::string const& name, std::vector<double> times, uint64_t allocations)
+  {
+    Result result;
+    result.name = name;
+    result.iterations = times.size();
+
+    if (!times.empty())
+    {
+      std::sort(times.begin(), times.end());
+
+      double total = 0.0;
+      for (double time : times)
+        total += time;
+
+      result.min = times.front();
+      result.max = times.back();
+      result.median = times[times.size() / 2];
+      result.p90 = times[times.size() * 9 / 10];
+      result.p99 = times[times.size() * 99 / 100];
+      result.mean = total / times.size();
+      result.allocations = (double)allocations / times.size();
+    }
+
+    fprintf(stderr, "%-32s %8.3f ms (min %.3f, max %.3f)\n", name.c_str(), result.median, result.min, result.max);
+    results_.push_back(result);
+  }
+
+  void Suite::setBytes(long long bytes)
+  {
+    if (!results_.empty())
+      results_.back().bytes = bytes;
+  }
+
+  void Suite::setItems(long long items)
+  {
+    if (results_.empty() || items <= 0)
+      return;
+
+    Result & result = results_.back();
+    result.items = items;
+
+    fprintf(stderr, "%-32s %8.1f ns/item, %.2f allocations/item\n", "",
+            result.median * 1000000.0 / items, result.allocations / items);
+  }
+
+  static void writeString(FILE * file, std::string const& str)
+  {
+    fputc('"', file);
+    for (char ch : str)
+    {
+      if (ch == '"' || ch == '\\')
+        fputc('\\', file);
+      fputc(ch, file);
+    }
+    fputc('"', file);
+  }
+
+  void Suite::writeJson(FILE * file) const
+  {
+    fprintf(file, "{\n  \"suite\": ");
+    writeString(file, name_);
+    fprintf(file, ",\n  \"results\": [\n");
+
+    for (std::size_t i = 0; i < results_.size(); ++i)
+    {
+      Result const& result = results_[i];
+
+      fprintf(file, "    {\"name\": ");
+      writeString(file, result.name);
+      fprintf(file, ", \"iterations\": %d, \"min\": %.6f, \"median\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"mean\": %.6f, \"max\": %.6f, \"allocations\": %.1f",
+              result.iterations, result.min, result.median, result.p90, result.p99, result.mean, result.max, result.allocations);
+
+      if (result.bytes > 0)
+        fprintf(file, ", \"bytes\": %lld, \"throughput\": %.3f", result.bytes, perf::throughput(result.bytes, result.median));
+
+      if (result.items > 0 && result.median > 0.0)
+        fprintf(file, ", \"items\": %lld, \"nsPerItem\": %.3f, \"itemsPerSecond\": %.0f, \"allocationsPerItem\": %.3f",
+                result.items, result.median * 1000000.0 / result.items, result.items * 1000.0 / result.median, result.allocations / result.items);
+
+      fprintf(file, "}%s\n", i + 1 < results_.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+  }
+
+  bool Suite::write(std::string const& filename) const
+  {
+    if (filename == "-")
+    {
+      writeJson(stdout);
+      return true;
+    }
+
+    FILE * file = fopen(filename.c_str(), "w");
+    if (!file)
+      return false;
+
+    writeJson(file);
+    fclose(file);
+    return true;
+  }
+
+  bool parseOptions(int argc, char * argv[], Options & options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const bool hasValue = i + 1 < argc;
+
+      if (strcmp(argv[i], "-o") == 0 && hasValue)
+        options.output = argv[++i];
+      else if (strcmp(argv[i], "-n") == 0 && hasValue)
+        options.iterations = std::max(1, atoi(argv[++i]));
+      else if (strcmp(argv[i], "-s") == 0 && hasValue)
+        options.scale = std::max(1, atoi(argv[++i]));
+      else
+      {
+        fprintf(stderr, "usage: %s [-o results.json] [-n iterations] [-s scale]\n", argv[0]);
+        return false;
+      }
+    }
+
+    return true;
+  }
+}
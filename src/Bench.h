@@ -0,0 +1,70 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdio.h>
+#include <stdint.h>
+
+namespace bench {
+
+  // Timings are in milliseconds
+  struct Result
+  {
+    std::string name;
+    int iterations = 0;
+    double min = 0.0;
+    double median = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double mean = 0.0;
+    double max = 0.0;
+    long long bytes = 0;
+    long long items = 0;
+    double allocations = 0.0;
+  };
+
+  // Number of heap allocations made through operator new since the program started
+  uint64_t allocationCount();
+
+  class Suite
+  {
+    public:
+      Suite(std::string const& name);
+
+      // Runs func the given number of times and records the timings under name.
+      // Setup is called before every run and is not part of the timing.
+      void run(std::string const& name, int iterations, std::function<void()> const& func,
+               std::function<void()> const& setup = std::function<void()>());
+
+      // Records timings that were measured by the caller
+      void add(std::string const& name, std::vector<double> times, uint64_t allocations = 0);
+
+      // Attach a byte count to the last result, used to report throughput
+      void setBytes(long long bytes);
+
+      // Attach the number of items processed by each run of the last result, used to report time and allocations per item
+      void setItems(long long items);
+
+      std::vector<Result> const& results() const { return results_; }
+
+      // Writes the results as JSON, a filename of "-" writes to stdout
+      bool write(std::string const& filename) const;
+      void writeJson(FILE * file) const;
+
+    private:
+      std::string name_;
+      std::vector<Result> results_;
+  };
+
+  struct Options
+  {
+    std::string output = "-";
+    int iterations = 5;
+    int scale = 1;
+  };
+
+  // Parses the common command line options, returns false if the arguments are invalid
+  bool parseOptions(int argc, char * argv[], Options & options);
+}
@@ -0,0 +1,14 @@
+
+#include "Editor.h"
+#include "Log.h"
+
+// The document and expression modules report errors through the editor, the benchmarks
+// that run without it use these instead
+void flashMessage(std::string const& message)
+{
+  logInfo(message);
+}
+
+void clearFlashMessage()
+{
+}
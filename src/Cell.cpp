@@ -1,6 +1,8 @@
 
 #include "Cell.h"
 
+#include <algorithm>
+
 static const std::string START = "#{";
 static const std::string END = "}";
 
@@ -31,4 +33,62 @@ std::string formatToStr(uint32_t format)
     return "";
 
   return START + str::fromInt(format) + END;
-}
\ No newline at end of file
+}
+
+std::string formatValue(double value, uint32_t format)
+{
+  const int decimals = (int)((format & DECIMALS_MASK) >> DECIMALS_SHIFT) - 1;
+
+  char buffer[str::DOUBLE_BUFFER_SIZE];
+  return std::string(buffer, str::formatDouble(buffer, value, decimals, (format & THOUSANDS) != 0));
+}
+
+void layoutCellRender(CellRender & render, int width, uint32_t format)
+{
+  render.width = width;
+  render.format = format;
+  render.line.assign(std::max(width, 0), ' ');
+
+  if (width <= 0)
+  {
+    render.start = 0;
+    render.length = 0;
+    return;
+  }
+
+  int length = render.text.size();
+  const bool truncate = length >= width;
+
+  if (truncate)
+    length = std::max(0, width - 3);
+
+  int start = 0;
+  if (!truncate)
+  {
+    switch (format & ALIGN_MASK)
+    {
+      case ALIGN_CENTER:
+        start = (width / 2) - (length / 2);
+        break;
+
+      case ALIGN_RIGHT:
+        start = width - length;
+        break;
+    }
+  }
+
+  for (int i = 0; i < length; ++i)
+    render.line[start + i] = render.text[i];
+
+  // Truncated text ends with '.. ' and is styled over the whole column
+  if (truncate)
+  {
+    for (int i = length; i < width && i < length + 2; ++i)
+      render.line[i] = '.';
+
+    length = width;
+  }
+
+  render.start = start;
+  render.length = length;
+}
@@ -2,7 +2,9 @@
 #pragma once
 
 #include "Str.h"
-#include "Expression.h"
+#include "Formula.h"
+
+#include <memory>
 
 static const uint32_t ALIGN_MASK      = 0x0000000F;
 static const uint32_t ALIGN_LEFT      = 0x00000000;
@@ -11,11 +13,35 @@ static const uint32_t ALIGN_CENTER    = 0x00000002;
 static const uint32_t FONT_MASK       = 0x000000F0;
 static const uint32_t FONT_BOLD       = 0x00000010;
 static const uint32_t FONT_UNDERLINE  = 0x00000020;
+static const uint32_t DECIMALS_MASK   = 0x00000F00;   //< Number of decimals + 1, 0 shows the shortest exact form
+static const uint32_t DECIMALS_SHIFT  = 8;
+static const uint32_t THOUSANDS       = 0x00001000;   //< Separate thousands with ','
+
+static const int MAX_DECIMALS = (DECIMALS_MASK >> DECIMALS_SHIFT) - 1;
 
 std::tuple<uint32_t, std::string> parseFormatAndValue(std::string const& str);
 uint32_t parseFormat(std::string const& str);
 std::string formatToStr(uint32_t format);
 
+// The text of a number in a cell with the given format
+std::string formatValue(double value, uint32_t format);
+
+// The display text of a cell decoded to utf32 and laid out for a column, cached so
+// the workspace does not need to decode and truncate every visible cell each frame.
+struct CellRender
+{
+  std::vector<uint32_t> text;   //< Display text as utf32
+  std::vector<uint32_t> line;   //< Text aligned and truncated to exactly 'width' characters
+  int start = 0;                //< The text occupies [start, start + length) of the line
+  int length = 0;
+  int width = -1;
+  uint32_t format = 0;
+  double value = 0.0;           //< The number the text was formatted from
+  bool valid = false;
+};
+
+void layoutCellRender(CellRender & render, int width, uint32_t format);
+
 struct Cell
 {
   std::string text;
@@ -23,7 +49,10 @@ struct Cell
   uint32_t format = 0;
 
   double value = 0.0;
+  bool number = false;                     //< The text is a number held in value, classified when the text is set
   bool hasExpression = false;
   bool evaluated = false;
-  std::vector<Expr> expression;
+  std::shared_ptr<const Formula> formula;  //< Shared with every cell holding the same relative formula
+
+  CellRender render;
 };
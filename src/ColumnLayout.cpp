@@ -0,0 +1,149 @@
+
+#include "ColumnLayout.h"
+
+#include <algorithm>
+
+static const int MIN_CAPACITY = 16;
+
+void ColumnLayout::setDefaultWidth(int width)
+{
+  if (width == defaultWidth_)
+    return;
+
+  defaultWidth_ = width;
+  rebuild();
+}
+
+int ColumnLayout::width(int column) const
+{
+  if (column < 0 || column >= widths_.size() || widths_[column] == 0)
+    return defaultWidth_;
+
+  return widths_[column];
+}
+
+void ColumnLayout::setWidth(int column, int width)
+{
+  if (column < 0)
+    return;
+
+  grow(column);
+
+  const int oldDelta = this->width(column) - defaultWidth_;
+  widths_[column] = width;
+  add(column, this->width(column) - defaultWidth_ - oldDelta);
+}
+
+void ColumnLayout::insertColumn(int column)
+{
+  if (column < 0 || column >= widths_.size())
+    return;
+
+  widths_.insert(widths_.begin() + column, 0);
+
+  if (widths_.back() == 0)
+    widths_.pop_back();
+
+  rebuild();
+}
+
+void ColumnLayout::removeColumn(int column)
+{
+  if (column < 0 || column >= widths_.size())
+    return;
+
+  widths_.erase(widths_.begin() + column);
+  widths_.push_back(0);
+  rebuild();
+}
+
+int ColumnLayout::offset(int column) const
+{
+  if (column <= 0)
+    return 0;
+
+  return column * defaultWidth_ + prefix(std::min<int>(column, widths_.size()));
+}
+
+int ColumnLayout::columnAt(int x) const
+{
+  if (x < 0)
+    return 0;
+
+  const int count = widths_.size();
+
+  // Walk down the tree, looking for the last column that starts at or before x
+  int column = 0;
+  int start = 0;
+
+  int step = 1;
+  while (step * 2 <= count)
+    step *= 2;
+
+  for (; step > 0; step /= 2)
+  {
+    const int next = column + step;
+    if (next <= count)
+    {
+      const int nextStart = start + tree_[next] + step * defaultWidth_;
+      if (nextStart <= x)
+      {
+        column = next;
+        start = nextStart;
+      }
+    }
+  }
+
+  // Beyond the tree all columns have the default width
+  if (column == count)
+    column += (x - start) / std::max(1, defaultWidth_);
+
+  return column;
+}
+
+void ColumnLayout::grow(int column)
+{
+  if (column < widths_.size())
+    return;
+
+  int capacity = std::max<int>(MIN_CAPACITY, widths_.size());
+  while (capacity <= column)
+    capacity *= 2;
+
+  widths_.resize(capacity, 0);
+  rebuild();
+}
+
+void ColumnLayout::rebuild()
+{
+  const int count = widths_.size();
+  tree_.assign(count + 1, 0);
+
+  // Build the tree in linear time by pushing each node into its parent
+  for (int i = 1; i <= count; ++i)
+  {
+    tree_[i] += width(i - 1) - defaultWidth_;
+
+    const int parent = i + (i & -i);
+    if (parent <= count)
+      tree_[parent] += tree_[i];
+  }
+}
+
+void ColumnLayout::add(int column, int delta)
+{
+  if (delta == 0)
+    return;
+
+  for (int i = column + 1; i < tree_.size(); i += i & -i)
+    tree_[i] += delta;
+}
+
+int ColumnLayout::prefix(int count) const
+{
+  int sum = 0;
+  for (int i = count; i > 0; i -= i & -i)
+    sum += tree_[i];
+
+  return sum;
+}
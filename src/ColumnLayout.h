@@ -0,0 +1,37 @@
+
+#pragma once
+
+#include <vector>
+
+// Keeps the width of every column in a Fenwick tree, so the x offset of a column
+// and the column found at a given x offset are answered in O(log n) instead of
+// summing the width of every column in between.
+class ColumnLayout
+{
+  public:
+    int defaultWidth() const { return defaultWidth_; }
+    void setDefaultWidth(int width);
+
+    int width(int column) const;
+    void setWidth(int column, int width);
+
+    void insertColumn(int column);
+    void removeColumn(int column);
+
+    // Returns the sum of the widths of all columns before 'column'
+    int offset(int column) const;
+
+    // Returns the column that covers the offset 'x'
+    int columnAt(int x) const;
+
+  private:
+    void grow(int column);
+    void rebuild();
+    void add(int column, int delta);
+    int prefix(int count) const;
+
+  private:
+    int defaultWidth_ = 1;
+    std::vector<int> widths_;   //< Explicitly set widths, 0 means the default width
+    std::vector<int> tree_;     //< Fenwick tree over (width - defaultWidth_), 1-based
+};
@@ -7,9 +7,30 @@
 #include "Tcl.h"
 #include "Log.h"
 
+#include <algorithm>
+#include <cctype>
+
 
 static Str commandSequence_;
 
+// The number of decimals a cell shows, numbers written with an exponent count as showing all of them
+static int shownDecimals(Index const& idx)
+{
+  const std::string text = doc::getCellDisplayText(idx);
+  if (text.find_first_of("eE") != std::string::npos)
+    return MAX_DECIMALS;
+
+  const std::size_t point = text.find('.');
+  if (point == std::string::npos)
+    return 0;
+
+  int decimals = 0;
+  for (std::size_t i = point + 1; i < text.size() && std::isdigit(text[i]); ++i)
+    ++decimals;
+
+  return decimals;
+}
+
 // List of all commands we support
 static std::vector<EditCommand> editCommands_ = {
   {
@@ -152,6 +173,46 @@ static std::vector<EditCommand> editCommands_ = {
       }
     }
   },
+  {
+    {'f', '.'}, false,
+    "Show one more decimal for numbers in the current cell",
+    [] (int) {
+      for (auto const& idx : doc::selectedCells())
+      {
+        const uint32_t oldFormat = doc::getCellFormat(idx);
+
+        // Starts from the decimals the shortest form shows, so no digits are lost
+        const int shown = (oldFormat & DECIMALS_MASK) ? ((oldFormat & DECIMALS_MASK) >> DECIMALS_SHIFT) - 1 : shownDecimals(idx);
+        const uint32_t decimals = std::min(shown + 1, MAX_DECIMALS);
+        const uint32_t newFormat = (oldFormat & ~DECIMALS_MASK) | ((decimals + 1) << DECIMALS_SHIFT);
+        doc::setCellFormat(idx, newFormat);
+      }
+    }
+  },
+  {
+    {'f', 'g'}, false,
+    "Show numbers in the current cell with as many decimals as they need",
+    [] (int) {
+      for (auto const& idx : doc::selectedCells())
+      {
+        const uint32_t oldFormat = doc::getCellFormat(idx);
+        const uint32_t newFormat = oldFormat & ~DECIMALS_MASK;
+        doc::setCellFormat(idx, newFormat);
+      }
+    }
+  },
+  {
+    {'f', ','}, false,
+    "Separate thousands in numbers in the current cell",
+    [] (int) {
+      for (auto const& idx : doc::selectedCells())
+      {
+        const uint32_t oldFormat = doc::getCellFormat(idx);
+        const uint32_t newFormat = oldFormat ^ THOUSANDS;
+        doc::setCellFormat(idx, newFormat);
+      }
+    }
+  },
 };
 
 static bool getEditCommand(uint32_t key1, uint32_t key2, EditCommand ** command)
@@ -0,0 +1,232 @@
+
+#include "Dependencies.h"
+#include "Formula.h"
+
+#include <algorithm>
+#include <numeric>
+
+// The formulas of one column sorted by row, with a tree of nodes over them that ranges point to
+struct ColumnNodes
+{
+  std::vector<int> rows;
+  std::vector<int> cells;
+  std::vector<int> tree;      //< Built the first time a range refers to the column, -1 where empty
+  int size = 0;
+};
+
+typedef std::vector<std::pair<int, int>> Edges;
+
+static void buildTree(ColumnNodes & column, int & nodeCount, Edges & edges)
+{
+  column.size = 1;
+  while (column.size < (int)column.cells.size())
+    column.size *= 2;
+
+  column.tree.assign(column.size * 2, -1);
+  std::copy(column.cells.begin(), column.cells.end(), column.tree.begin() + column.size);
+
+  // A node with a single child is the child itself
+  for (int node = column.size - 1; node > 0; --node)
+  {
+    const int left = column.tree[node * 2];
+    const int right = column.tree[node * 2 + 1];
+
+    if (left < 0 || right < 0)
+    {
+      column.tree[node] = std::max(left, right);
+    }
+    else
+    {
+      column.tree[node] = nodeCount++;
+      edges.push_back(std::make_pair(column.tree[node], left));
+      edges.push_back(std::make_pair(column.tree[node], right));
+    }
+  }
+}
+
+static void addRangeEdges(int from, ColumnNodes & column, int y0, int y1, int & nodeCount, Edges & edges)
+{
+  int first = std::lower_bound(column.rows.begin(), column.rows.end(), y0) - column.rows.begin();
+  int last = std::upper_bound(column.rows.begin(), column.rows.end(), y1) - column.rows.begin();
+
+  if (first >= last)
+    return;
+
+  if (column.tree.empty())
+    buildTree(column, nodeCount, edges);
+
+  for (first += column.size, last += column.size; first < last; first /= 2, last /= 2)
+  {
+    if (first & 1)
+    {
+      if (column.tree[first] >= 0)
+        edges.push_back(std::make_pair(from, column.tree[first]));
+      first++;
+    }
+
+    if (last & 1)
+    {
+      last--;
+      if (column.tree[last] >= 0)
+        edges.push_back(std::make_pair(from, column.tree[last]));
+    }
+  }
+}
+
+DependencyOrder orderDependencies(std::vector<std::pair<Index, Formula const*>> const& formulas)
+{
+  const int cellCount = formulas.size();
+
+  int width = 0;
+  for (auto const& formula : formulas)
+    width = std::max(width, formula.first.x + 1);
+
+  // Cells are visited by column and row, so the formulas of a column that do not depend on each
+  // other stay in row order and can still be evaluated a block at a time
+  std::vector<std::vector<std::pair<int, int>>> columnCells(width);
+  for (int node = 0; node < cellCount; ++node)
+  {
+    Index const& idx = formulas[node].first;
+    columnCells[idx.x].push_back(std::make_pair(idx.y, node));
+  }
+
+  std::vector<ColumnNodes> columns(width);
+  std::vector<int> sorted;
+  sorted.reserve(cellCount);
+
+  for (int x = 0; x < width; ++x)
+  {
+    std::sort(columnCells[x].begin(), columnCells[x].end());
+
+    for (auto const& cell : columnCells[x])
+    {
+      columns[x].rows.push_back(cell.first);
+      columns[x].cells.push_back(cell.second);
+      sorted.push_back(cell.second);
+    }
+  }
+
+  int nodeCount = cellCount;
+  Edges edges;
+  edges.reserve(cellCount * 2);
+
+  std::vector<std::pair<Index, Index>> refs;
+
+  for (int node = 0; node < cellCount; ++node)
+  {
+    refs.clear();
+    formulas[node].second->references(formulas[node].first, refs);
+
+    for (auto const& ref : refs)
+    {
+      const int x0 = std::max(ref.first.x, 0);
+      const int x1 = std::min(ref.second.x, width - 1);
+
+      for (int x = x0; x <= x1; ++x)
+      {
+        ColumnNodes & column = columns[x];
+
+        if (ref.first.y == ref.second.y)
+        {
+          auto row = std::lower_bound(column.rows.begin(), column.rows.end(), ref.first.y);
+          if (row != column.rows.end() && *row == ref.first.y)
+            edges.push_back(std::make_pair(node, column.cells[row - column.rows.begin()]));
+        }
+        else
+        {
+          addRangeEdges(node, column, ref.first.y, ref.second.y, nodeCount, edges);
+        }
+      }
+    }
+  }
+
+  // The edges of each node as one contiguous run
+  std::vector<int> offsets(nodeCount + 1, 0);
+  std::vector<int> targets(edges.size());
+
+  for (auto const& edge : edges)
+    offsets[edge.first + 1]++;
+
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  {
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    for (auto const& edge : edges)
+      targets[next[edge.first]++] = edge.second;
+  }
+
+  // Tarjan's algorithm with an explicit stack. A component is complete only after every
+  // component it depends on, so they come out in the order they have to be evaluated in.
+  std::vector<int> index(nodeCount, -1);
+  std::vector<int> low(nodeCount, 0);
+  std::vector<uint8_t> onStack(nodeCount, 0);
+  std::vector<int> stack;
+  std::vector<std::pair<int, int>> calls;   //< A node and the next of its edges to follow
+  int counter = 0;
+
+  DependencyOrder order;
+  order.cells.reserve(cellCount);
+
+  auto visit = [&](int node) {
+    index[node] = low[node] = counter++;
+    stack.push_back(node);
+    onStack[node] = 1;
+    calls.push_back(std::make_pair(node, offsets[node]));
+  };
+
+  for (int root : sorted)
+  {
+    if (index[root] >= 0)
+      continue;
+
+    visit(root);
+
+    while (!calls.empty())
+    {
+      const int node = calls.back().first;
+
+      if (calls.back().second < offsets[node + 1])
+      {
+        const int target = targets[calls.back().second++];
+
+        if (index[target] < 0)
+          visit(target);
+        else if (onStack[target])
+          low[node] = std::min(low[node], index[target]);
+
+        continue;
+      }
+
+      calls.pop_back();
+      if (!calls.empty())
+        low[calls.back().first] = std::min(low[calls.back().first], low[node]);
+
+      if (low[node] != index[node])
+        continue;
+
+      // Pop the component, the tree nodes in it only relay the edges of ranges
+      const int first = order.cells.size();
+      int size = 0;
+      int member;
+
+      do
+      {
+        member = stack.back();
+        stack.pop_back();
+        onStack[member] = 0;
+        size++;
+
+        if (member < cellCount)
+          order.cells.push_back(formulas[member].first);
+      } while (member != node);
+
+      const bool selfReference = size == 1 && node < cellCount &&
+                                 std::find(targets.begin() + offsets[node], targets.begin() + offsets[node + 1], node) != targets.begin() + offsets[node + 1];
+
+      if ((int)order.cells.size() > first && (size > 1 || selfReference))
+        order.cycles.push_back(std::make_pair(first, (int)order.cells.size()));
+    }
+  }
+
+  return order;
+}
@@ -0,0 +1,22 @@
+
+#pragma once
+
+#include "Index.h"
+
+#include <vector>
+#include <utility>
+
+class Formula;
+
+// The order to evaluate the formulas of a document in, and the circular references among them
+struct DependencyOrder
+{
+  std::vector<Index> cells;                   //< Every formula comes after the formulas it depends on
+  std::vector<std::pair<int, int>> cycles;    //< Runs [first, last) of cells that form a circular reference
+};
+
+// Finds the strongly connected components of the graph of formulas and the formulas they refer
+// to, without recursion and in time linear in the size of the graph. A range does not add an edge
+// for every formula in it, the formulas of each column are covered by a tree of nodes instead, so
+// a range adds O(log n) edges per column.
+DependencyOrder orderDependencies(std::vector<std::pair<Index, Formula const*>> const& formulas);
@@ -2,7 +2,12 @@
 #include "Document.h"
 #include "Str.h"
 #include "Cell.h"
+#include "ColumnLayout.h"
 #include "Editor.h"
+#include "Dependencies.h"
+#include "Perf.h"
+#include "Trace.h"
+#include "Alloc.h"
 #include "Log.h"
 
 #include <assert.h>
@@ -21,9 +26,15 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
+#include <functional>
 #include <cmath>
+#include <atomic>
+#include <memory>
 
 #include <ini.h>
+#include <bx/thread.h>
+#include <bx/mutex.h>
+#include <bx/sem.h>
 
 #include "Tcl.h"
 
@@ -34,12 +45,33 @@ namespace doc {
   static const tcl::Variable DEFAULT_ROW_COUNT("doc_defaultRowCount", 40);
   static const tcl::Variable DEFAULT_COLUMN_COUNT("doc_defaultColumnCount", 16);
   static const tcl::Variable DEFAULT_COLUMN_WIDTH("doc_defaultColumnWidth", 20);
+  static const tcl::Variable LAZY_EVALUATION("doc_lazyEvaluation", false);
+  static const tcl::Variable BACKGROUND_RECALC("doc_backgroundRecalc", false);
+  static const tcl::Variable RECALC_BUDGET("doc_recalcBudget", 10000);
+  static const tcl::Variable ITERATIVE_CALCULATION("doc_iterativeCalculation", 0);
+
+  // Display text of a formula that is not evaluated yet, see evaluatePending()
+  static const std::string PENDING_DISPLAY = "...";
+
+  // Pending cells evaluated between checks of the time budget
+  static const int PENDING_CHUNK_SIZE = 1024;
+
+  // Cell evaluations between checks of the recalculation budget, see recalcStopped()
+  static const int BUDGET_CHECK_INTERVAL = 64;
+
+  // Display text of the formulas in a circular reference and of the formulas that read them,
+  // unless they are calculated iteratively
+  static const std::string CYCLE_DISPLAY = "#CYCLE";
+
+  // Iterative calculation of a circular reference stops once no value changes by more than this
+  static const double ITERATION_TOLERANCE = 0.001;
 
   struct Document
   {
     int width_ = 0;
     int height_ = 0;
     std::unordered_map<int, int> columnWidth_;
+    ColumnLayout columnLayout_;
     std::unordered_map<Index, Cell> cells_;
     std::string filename_;
     bool readOnly_ = false;
@@ -70,8 +102,11 @@ namespace doc {
     EditAction action_;
   };
 
+  static int nextBufferId_ = 0;
+
   struct Buffer
   {
+    int id_ = nextBufferId_++;
     Document doc_;
     Index cursorPos_ = Index(0, 0);
     Index scroll_ = Index(0, 0);
@@ -79,8 +114,33 @@ namespace doc {
     Index selectionEnd_ = Index(-1, -1);
     std::vector<UndoState> undoStack_;
     std::vector<UndoState> redoStack_;
+    ValueStore values_;
+    std::vector<Index> pending_;        //< Formulas left for evaluatePending(), sorted by column
+    std::size_t nextPending_ = 0;
+    uint64_t version_ = 0;              //< Bumped by every recalculation, see requestRecalc()
+    bool stale_ = false;                //< A background recalculation is in flight
+    bool interrupted_ = false;          //< A recalculation ran out of budget, see recalc()
+    DependencyOrder dependencies_;      //< See analyzeDependencies()
+    std::unordered_set<Index> cyclic_;  //< Formulas in a circular reference
+    std::unordered_set<Index> cycleDependents_;  //< Formulas that depend on one, but are not part of it
+    bool dependenciesValid_ = false;
+  };
+
+  // A copy of a document being recalculated on the worker thread, see requestRecalc()
+  struct RecalcJob
+  {
+    Buffer buffer_;
+    int bufferId_ = 0;
+    uint64_t version_ = 0;
+    std::atomic<bool> cancelled_{false};
+    int iterations_ = 0;
+    double recalcTime_ = 0.0;
+    int recalcCells_ = 0;
   };
 
+  // The buffer being recalculated on this thread, if it is the worker thread
+  static thread_local RecalcJob * recalcJob_ = nullptr;
+
   static std::vector<Buffer> & documentBuffers()
   {
     static std::vector<Buffer> buffer;
@@ -91,6 +151,9 @@ namespace doc {
 
   static Buffer & currentBuffer()
   {
+    if (recalcJob_)
+      return recalcJob_->buffer_;
+
     assert(!documentBuffers().empty());
     return documentBuffers().at(currentBufferIndex_);
   }
@@ -247,14 +310,17 @@ namespace doc {
     currentDoc().readOnly_ = false;
   }
 
+  static void cancelRecalc(Buffer & buffer);
+
   void close()
   {
+    cancelRecalc(currentBuffer());
     documentBuffers().erase(documentBuffers().begin() + currentBufferIndex_);
 
     if (documentBuffers().empty())
       createDefaultEmpty();
     else
-      currentBufferIndex_ = std::max(0, std::min((int)documentBuffers().size(), currentBufferIndex()));
+      currentBufferIndex_ = std::max(0, std::min((int)documentBuffers().size() - 1, currentBufferIndex()));
   }
 
   static Cell & getCell(Index const& idx)
@@ -262,19 +328,362 @@ namespace doc {
     return currentDoc().cells_[idx];
   }
 
-  static bool hasCell(Index const& idx)
+  // Unlike getCell() this never creates the cell, returns null if there is no cell at idx
+  static Cell * findCell(Index const& idx)
+  {
+    auto it = currentDoc().cells_.find(idx);
+    return it != currentDoc().cells_.end() ? &it->second : nullptr;
+  }
+
+  // Calls func(idx, cell) for every cell in the range [start, end]. Ranges larger than the
+  // number of cells in the document walk the cells instead of the range, so a huge mostly
+  // empty range does not cost a lookup for every position in it.
+  template <typename Func>
+  static void forEachCell(Index const& start, Index const& end, Func func)
+  {
+    Document & doc = currentDoc();
+    const int64_t area = int64_t(end.x - start.x + 1) * (end.y - start.y + 1);
+
+    if (area > (int64_t)doc.cells_.size())
+    {
+      for (auto & it : doc.cells_)
+      {
+        Index const& idx = it.first;
+        if (idx.x >= start.x && idx.x <= end.x && idx.y >= start.y && idx.y <= end.y)
+          func(idx, it.second);
+      }
+    }
+    else
+    {
+      for (int y = start.y; y <= end.y; ++y)
+        for (int x = start.x; x <= end.x; ++x)
+        {
+          Cell * cell = findCell(Index(x, y));
+          if (cell)
+            func(Index(x, y), *cell);
+        }
+    }
+  }
+
+  static std::string getText(Cell const& cell, Index const& idx)
+  {
+    if (cell.hasExpression && cell.formula && cell.formula->valid())
+      return "=" + exprToString(cell.formula->expression(idx));
+
+    return cell.text;
+  }
+
+  // Copies a cell to another position, a formula still refers to the same cells there
+  static Cell copyCell(Cell const& cell, Index const& from, Index const& to)
+  {
+    Cell copy = cell;
+
+    if (cell.hasExpression && cell.formula && cell.formula->valid())
+      copy.formula = Formula::intern(cell.formula->expression(from), to);
+
+    return copy;
+  }
+
+  static ColumnLayout & columnLayout()
   {
-    return currentDoc().cells_.find(idx) != currentDoc().cells_.end();
+    ColumnLayout & layout = currentDoc().columnLayout_;
+    layout.setDefaultWidth(DEFAULT_COLUMN_WIDTH.toInt());
+    return layout;
   }
 
-  static std::string getText(Cell const& cell)
+  static void storeColumnWidth(int column, int width)
   {
-    if (cell.hasExpression && !cell.expression.empty())
-      return "=" + exprToString(cell.expression);
+    currentDoc().columnWidth_[column] = width;
+    columnLayout().setWidth(column, width);
+  }
+
+  static void setDisplay(Cell & cell, std::string const& display)
+  {
+    if (cell.display != display)
+    {
+      cell.display = display;
+      cell.render.valid = false;
+    }
+  }
+
+  // The result of a formula is only formatted when the cell is shown, see displayText()
+  static void showValue(Cell & cell)
+  {
+    if (!cell.display.empty())
+    {
+      cell.display.clear();
+      cell.render.valid = false;
+    }
+  }
+
+  static bool showsValue(Cell const& cell)
+  {
+    return cell.hasExpression && cell.display.empty();
+  }
+
+  static std::string displayText(Cell const& cell)
+  {
+    if (!cell.display.empty())
+      return cell.display;
+
+    // Numbers typed into a cell are shown as typed unless the cell has a number format
+    if (cell.hasExpression || (cell.number && (cell.format & (DECIMALS_MASK | THOUSANDS))))
+      return formatValue(cell.value, cell.format);
 
     return cell.text;
   }
 
+  // Queues the formulas that are not evaluated yet for evaluatePending()
+  static void schedulePending()
+  {
+    Buffer & buffer = currentBuffer();
+
+    buffer.pending_.clear();
+    buffer.nextPending_ = 0;
+
+    for (auto const& it : buffer.doc_.cells_)
+    {
+      if (it.second.hasExpression && !it.second.evaluated)
+        buffer.pending_.push_back(it.first);
+    }
+
+    // Keeps the runs of a shared formula together, so they are still evaluated a block at a time
+    std::sort(buffer.pending_.begin(), buffer.pending_.end(), [](Index const& lhs, Index const& rhs) {
+      return lhs.x < rhs.x || (lhs.x == rhs.x && lhs.y < rhs.y);
+    });
+  }
+
+  static bool evaluateBuffer(bool lazy, int iterations);
+
+  // Leaves the formulas a recalculation that ran out of budget did not get to for recalc()
+  static void interruptRecalc()
+  {
+    Buffer & buffer = currentBuffer();
+
+    schedulePending();
+
+    for (Index const& idx : buffer.pending_)
+      setDisplay(buffer.doc_.cells_[idx], PENDING_DISPLAY);
+
+    buffer.interrupted_ = true;
+
+    logInfo("Recalculation stopped after ", RECALC_BUDGET.toInt(), " ms with ", (int)buffer.pending_.size(), " cells left");
+    flashMessage("Recalculation ran out of time, use recalc to continue");
+  }
+
+  // Limits a recalculation on this thread to doc_recalcBudget milliseconds. Only the outermost
+  // budget counts, so evaluation started while one is running shares it.
+  class RecalcBudget
+  {
+    public:
+      explicit RecalcBudget(int budget)
+        : outermost_(!active_)
+      {
+        if (!outermost_)
+          return;
+
+        active_ = true;
+        stopped_ = false;
+        start_ = perf::now();
+        budget_ = budget;
+        checks_ = 0;
+      }
+
+      ~RecalcBudget()
+      {
+        if (outermost_)
+          active_ = false;
+      }
+
+      // True once the budget ran out, or the background recalculation was cancelled
+      static bool stopped()
+      {
+        if (!active_)
+          return false;
+
+        if (stopped_)
+          return true;
+
+        if (recalcJob_ && recalcJob_->cancelled_.load(std::memory_order_relaxed))
+          stopped_ = true;
+        else if (active_ && budget_ > 0 && ++checks_ % BUDGET_CHECK_INTERVAL == 0)
+          stopped_ = perf::elapsed(start_) >= budget_;
+
+        return stopped_;
+      }
+
+    private:
+      bool outermost_;
+
+      static thread_local bool active_;
+      static thread_local bool stopped_;
+      static thread_local int64_t start_;
+      static thread_local int budget_;
+      static thread_local int checks_;
+  };
+
+  thread_local bool RecalcBudget::active_ = false;
+  thread_local bool RecalcBudget::stopped_ = false;
+  thread_local int64_t RecalcBudget::start_ = 0;
+  thread_local int RecalcBudget::budget_ = 0;
+  thread_local int RecalcBudget::checks_ = 0;
+
+  static bool recalcStopped()
+  {
+    return RecalcBudget::stopped();
+  }
+
+  // Recalculates one document copy at a time. A newer job for the same buffer replaces the
+  // queued one and cancels the running one, finished jobs wait for applyRecalc().
+  struct RecalcWorker
+  {
+    ~RecalcWorker()
+    {
+      if (!thread_.isRunning())
+        return;
+
+      {
+        bx::MutexScope lock(mutex_);
+        quit_ = true;
+
+        if (running_)
+          running_->cancelled_ = true;
+      }
+
+      wake_.post();
+      thread_.shutdown();
+    }
+
+    bx::Thread thread_;
+    bx::Mutex mutex_;
+    bx::Semaphore wake_;
+    std::vector<std::unique_ptr<RecalcJob>> queued_;
+    std::vector<std::unique_ptr<RecalcJob>> finished_;
+    RecalcJob * running_ = nullptr;
+    bool quit_ = false;
+  };
+
+  static RecalcWorker & recalcWorker()
+  {
+    static RecalcWorker worker;
+    return worker;
+  }
+
+  static int32_t recalcThread(void * userData)
+  {
+    RecalcWorker & worker = *static_cast<RecalcWorker *>(userData);
+
+    while (true)
+    {
+      worker.wake_.wait();
+
+      std::unique_ptr<RecalcJob> job;
+      {
+        bx::MutexScope lock(worker.mutex_);
+        if (worker.quit_)
+          return 0;
+
+        if (worker.queued_.empty())
+          continue;
+
+        job = std::move(worker.queued_.front());
+        worker.queued_.erase(worker.queued_.begin());
+        worker.running_ = job.get();
+      }
+
+      recalcJob_ = job.get();
+      RecalcBudget budget(0);
+      const bool done = evaluateBuffer(false, job->iterations_);
+      job->recalcTime_ = perf::stats().recalcTime;
+      job->recalcCells_ = perf::stats().recalcCells;
+      recalcJob_ = nullptr;
+
+      bx::MutexScope lock(worker.mutex_);
+      worker.running_ = nullptr;
+
+      if (done && !job->cancelled_)
+        worker.finished_.push_back(std::move(job));
+    }
+  }
+
+  // Drops the queued and running recalculations of a buffer, their results are out of date
+  static void cancelRecalc(Buffer & buffer)
+  {
+    buffer.version_++;
+    buffer.stale_ = false;
+
+    RecalcWorker & worker = recalcWorker();
+    bx::MutexScope lock(worker.mutex_);
+
+    if (worker.running_ && worker.running_->bufferId_ == buffer.id_)
+      worker.running_->cancelled_ = true;
+
+    worker.queued_.erase(std::remove_if(worker.queued_.begin(), worker.queued_.end(), [&buffer](std::unique_ptr<RecalcJob> const& job) {
+      return job->bufferId_ == buffer.id_;
+    }), worker.queued_.end());
+  }
+
+  static int iterationLimit()
+  {
+    return std::max(0, ITERATIVE_CALCULATION.toInt());
+  }
+
+  // Recalculates a copy of the current document on the worker thread. Until the results are
+  // applied the cells keep their previous values, formulas that were never evaluated show
+  // as pending and nothing on this thread evaluates them.
+  static void requestRecalc()
+  {
+    Buffer & buffer = currentBuffer();
+    cancelRecalc(buffer);
+
+    for (auto & it : buffer.doc_.cells_)
+    {
+      Cell & cell = it.second;
+      if (!cell.evaluated)
+      {
+        cell.evaluated = true;
+        if (cell.hasExpression)
+          setDisplay(cell, PENDING_DISPLAY);
+        else
+          showValue(cell);
+      }
+    }
+
+    buffer.pending_.clear();
+    buffer.nextPending_ = 0;
+    buffer.stale_ = true;
+    buffer.interrupted_ = false;
+
+    std::unique_ptr<RecalcJob> job(new RecalcJob());
+    job->buffer_.doc_ = buffer.doc_;
+    job->buffer_.dependencies_ = buffer.dependencies_;
+    job->buffer_.cyclic_ = buffer.cyclic_;
+    job->buffer_.cycleDependents_ = buffer.cycleDependents_;
+    job->buffer_.dependenciesValid_ = buffer.dependenciesValid_;
+    job->bufferId_ = buffer.id_;
+    job->version_ = buffer.version_;
+    job->iterations_ = iterationLimit();
+
+    RecalcWorker & worker = recalcWorker();
+    {
+      bx::MutexScope lock(worker.mutex_);
+      worker.queued_.push_back(std::move(job));
+
+      if (!worker.thread_.isRunning())
+        worker.thread_.init(recalcThread, &worker);
+    }
+
+    worker.wake_.post();
+  }
+
+  static void recalculate()
+  {
+    if (BACKGROUND_RECALC.toBool())
+      requestRecalc();
+    else
+      evaluateDocument();
+  }
+
   static bool forceUndoMerge_ = false;
 
   static void takeUndoSnapshot(EditAction action, bool canMerge)
@@ -305,6 +714,13 @@ namespace doc {
       UndoState const& state = currentBuffer().undoStack_.back();
       currentDoc() = state.doc_;
       cursorPos() = state.cursor_;
+      currentBuffer().values_.clear();
+      currentBuffer().dependenciesValid_ = false;
+
+      if (BACKGROUND_RECALC.toBool())
+        requestRecalc();
+      else
+        schedulePending();
 
       currentBuffer().undoStack_.pop_back();
       return true;
@@ -322,6 +738,13 @@ namespace doc {
       UndoState const& state = currentBuffer().redoStack_.back();
       currentDoc() = state.doc_;
       cursorPos() = state.cursor_;
+      currentBuffer().values_.clear();
+      currentBuffer().dependenciesValid_ = false;
+
+      if (BACKGROUND_RECALC.toBool())
+        requestRecalc();
+      else
+        schedulePending();
 
       currentBuffer().redoStack_.pop_back();
 
@@ -355,9 +778,11 @@ namespace doc {
     {
       for (int x = 0; x < currentDoc().width_; ++x)
       {
-        Cell const& cell = getCell(Index(x, y));
+        const Index idx(x, y);
 
-        file << getText(cell);
+        Cell const* cell = findCell(idx);
+        if (cell)
+          file << getText(*cell, idx);
 
         if (x < (currentDoc().width_ - 1))
         {
@@ -376,8 +801,12 @@ namespace doc {
 
   bool save(std::string const& filename)
   {
+    ALLOC_SCOPE("save");
+
     logInfo("Saving document: ", filename);
 
+    const int64_t start = perf::now();
+
     std::ofstream file(filename.c_str());
     if (!file.is_open())
     {
@@ -390,7 +819,7 @@ namespace doc {
     std::vector<Index> allCells;
     allCells.reserve(currentDoc().cells_.size());
 
-    for (auto it : currentDoc().cells_)
+    for (auto const& it : currentDoc().cells_)
       allCells.push_back(it.first);
 
     std::stable_sort(allCells.begin(), allCells.end(), [](Index const& lhs, Index const& rhs) -> bool { return lhs.y < rhs.y; });
@@ -417,7 +846,7 @@ namespace doc {
     file << std::endl << "[data]" << std::endl;
     for (auto idx: allCells)
     {
-      const std::string text = getText(getCell(idx));
+      const std::string text = getText(*findCell(idx), idx);
 
       if (!text.empty())
         file << idx.toStr() << " = " << text << std::endl;
@@ -427,7 +856,7 @@ namespace doc {
     file << std::endl << "[format]" << std::endl;
     for (auto idx: allCells)
     { 
-      const Cell & cell = getCell(idx);
+      const Cell & cell = *findCell(idx);
 
       if (cell.format != 0)
         file << idx.toStr() << " = " << formatToStr(cell.format) << std::endl;
@@ -435,6 +864,9 @@ namespace doc {
 
     file << std::endl;
 
+    perf::stats().saveBytes = file.tellp();
+    perf::stats().saveTime = perf::elapsed(start);
+
     currentDoc().filename_ = filename;
     return true;
   }
@@ -480,7 +912,7 @@ namespace doc {
 
       int width = getColumnWidth(idx.x);
       if (width < cell.text.size())
-        currentDoc().columnWidth_[idx.x] = cell.text.size() + 1;
+        storeColumnWidth(idx.x, cell.text.size() + 1);
     }
     else
     {
@@ -494,19 +926,28 @@ namespace doc {
     if (currentDoc().height_ < (idx.y + 1))
       currentDoc().height_ = (idx.y + 1);
 
+    cell.render.valid = false;
+
+    cell.value = 0.0;
+
     if (cell.text.front() == '=')
     {
       cell.hasExpression = true;
-      cell.expression = parseExpression(cell.text.substr(1));
+      cell.number = false;
+      cell.formula = Formula::intern(cell.text.substr(1), idx);
     }
     else
     {
       cell.hasExpression = false;
+      cell.number = str::parseNumber(cell.text, cell.value);
+      cell.formula.reset();
     }
   }
 
   static bool loadCSV(std::string const& data, char defaultDelimiter)
   {
+    TRACE_SCOPE("doc::loadCSV");
+
     createDefaultEmpty();
     currentDoc().width_ = 0;
     currentDoc().height_ = 0;
@@ -589,7 +1030,7 @@ namespace doc {
           const int col = Index::strToColumn(std::string(ini_property_name(ini, columnsSection, i)));
           const int width = std::atoi(ini_property_value(ini, columnsSection, i));
 
-          currentDoc().columnWidth_[col] = width;
+          storeColumnWidth(col, width);
         }
       }      
     }
@@ -637,6 +1078,11 @@ namespace doc {
 
   bool load(std::string const& filename)
   {
+    TRACE_SCOPE("doc::load");
+    ALLOC_SCOPE("load");
+
+    const int64_t start = perf::now();
+
     std::ifstream file(filename.c_str());
     if (!file.is_open())
     {
@@ -677,6 +1123,9 @@ namespace doc {
     currentDoc().filename_ = filename;
     currentDoc().readOnly_ = false;
 
+    perf::stats().loadBytes = data.size();
+    perf::stats().loadTime = perf::elapsed(start);
+
     return true;
   }
 
@@ -693,12 +1142,17 @@ namespace doc {
 
   int getColumnWidth(int column)
   {
-    auto col = currentDoc().columnWidth_.find(column);
+    return columnLayout().width(column);
+  }
 
-    if (col == currentDoc().columnWidth_.end())
-      return DEFAULT_COLUMN_WIDTH.toInt();
+  int getColumnOffset(int column)
+  {
+    return columnLayout().offset(column);
+  }
 
-    return (*col).second;
+  int getColumnAt(int x)
+  {
+    return columnLayout().columnAt(x);
   }
 
   void setColumnWidth(int column, int width)
@@ -707,7 +1161,7 @@ namespace doc {
       return;
 
     takeUndoSnapshot(EditAction::ColumnWidth, true);
-    currentDoc().columnWidth_[column] = std::max(3, width);
+    storeColumnWidth(column, std::max(3, width));
   }
 
   int getRowCount()
@@ -720,84 +1174,570 @@ namespace doc {
     return currentDoc().width_;
   }
 
-  static void collectDependencies(Cell const& cell, Index const& idx, std::unordered_set<Index> & deps)
+  static void evaluateCell(Index const& idx, Cell & cell)
   {
-    if (!cell.hasExpression)
+    if (cell.hasExpression && recalcStopped())
       return;
 
-    for (auto const& expr : cell.expression)
+    cell.evaluated = true;
+
+    if (cell.hasExpression)
     {
-      if (expr.type_ == Expr::Cell)
+      perf::stats().recalcCells++;
+
+      const double value = cell.formula->evaluate(idx);
+
+      // Cells it depends on might have been skipped once the recalculation stopped
+      if (recalcStopped())
       {
-        const auto result = deps.insert(expr.startIndex_);
-        if (result.second)
-          collectDependencies(getCell(expr.startIndex_), expr.startIndex_, deps);
+        cell.evaluated = false;
+        return;
       }
-      else if (expr.type_ == Expr::Range)
+
+      cell.value = value;
+      showValue(cell);
+    }
+
+    currentBuffer().values_.set(idx.x, idx.y, cell.value, cell.hasExpression || cell.number);
+  }
+
+  // Calls func(idx) for every formula in the range [start, end] that is not evaluated yet
+  template <typename Func>
+  static void forEachPendingCell(Index const& start, Index const& end, Func func)
+  {
+    ValueStore const& store = currentBuffer().values_;
+
+    if (!store.valid())
+    {
+      forEachCell(start, end, [&func](Index const& idx, Cell & cell) {
+        if (cell.hasExpression && !cell.evaluated)
+          func(idx);
+      });
+      return;
+    }
+
+    const int y0 = std::max(start.y, 0);
+    for (int x = std::max(start.x, 0); x <= end.x; ++x)
+    {
+      for (int row = store.findPending(x, y0, end.y - y0 + 1); row >= 0; row = store.findPending(x, row + 1, end.y - row))
+        func(Index(x, row));
+    }
+  }
+
+  // Evaluates a cell that is read before the recalculation got to it. The formulas it depends on
+  // are evaluated first, from an explicit stack instead of recursing through Formula::evaluate(),
+  // so reading the end of a long chain of formulas does not overflow the stack.
+  static void evaluateOnDemand(Index const& idx, Cell & cell)
+  {
+    struct Entry
+    {
+      Index idx;
+      bool expanded;
+    };
+
+    std::vector<Entry> stack;
+    std::unordered_set<Index> expanded;
+    std::vector<std::pair<Index, Index>> refs;
+
+    stack.push_back({ idx, false });
+
+    while (!stack.empty() && !recalcStopped())
+    {
+      const Entry entry = stack.back();
+      Cell * dependency = findCell(entry.idx);
+
+      if (!dependency || dependency->evaluated || !dependency->hasExpression || !dependency->formula || !dependency->formula->valid())
+      {
+        stack.pop_back();
+        continue;
+      }
+
+      // All of its dependencies are evaluated by now, or are part of a circular reference
+      if (entry.expanded)
+      {
+        stack.pop_back();
+        expanded.erase(entry.idx);
+        evaluateCell(entry.idx, *dependency);
+        continue;
+      }
+
+      stack.back().expanded = true;
+      expanded.insert(entry.idx);
+
+      refs.clear();
+      dependency->formula->references(entry.idx, refs);
+
+      for (auto const& ref : refs)
       {
-        const Index startIdx = expr.startIndex_;
-        const Index endIdx = expr.endIndex_;
+        forEachPendingCell(ref.first, ref.second, [&stack, &expanded](Index const& pending) {
+          if (!expanded.count(pending))
+            stack.push_back({ pending, false });
+        });
+      }
+    }
+
+    if (!cell.evaluated)
+      evaluateCell(idx, cell);
+  }
+
+  // Shorter runs of a shared formula are not worth setting up a block for
+  static const int MIN_RUN_LENGTH = 8;
+
+  // Evaluates runs of cells down a column that share a formula a block of rows at a time,
+  // the cells that could not be evaluated this way are left for evaluateCell()
+  static void evaluateColumnRuns(std::vector<std::pair<Index, Cell *>> & formulas)
+  {
+    ValueStore & store = currentBuffer().values_;
+
+    std::sort(formulas.begin(), formulas.end(), [](std::pair<Index, Cell *> const& lhs, std::pair<Index, Cell *> const& rhs) {
+      return lhs.first.x < rhs.first.x || (lhs.first.x == rhs.first.x && lhs.first.y < rhs.first.y);
+    });
+
+    double results[Program::BLOCK_SIZE];
+
+    std::size_t start = 0;
+    while (start < formulas.size())
+    {
+      Formula const* formula = formulas[start].second->formula.get();
+
+      std::size_t end = start + 1;
+      while (end < formulas.size() &&
+             formulas[end].first.x == formulas[start].first.x &&
+             formulas[end].first.y == formulas[end - 1].first.y + 1 &&
+             formulas[end].second->formula.get() == formula)
+        end++;
+
+      if (end - start >= MIN_RUN_LENGTH)
+      {
+        for (std::size_t block = start; block < end && !recalcStopped(); block += Program::BLOCK_SIZE)
+        {
+          const int count = std::min<std::size_t>(Program::BLOCK_SIZE, end - block);
 
-        for (int y = startIdx.y; y <= endIdx.y; ++y)
-          for (int x = startIdx.x; x <= endIdx.x; ++x)
+          if (!formula->evaluateBlock(formulas[block].first, count, results))
+            continue;
+
+          if (recalcStopped())
+            break;
+
+          for (int i = 0; i < count; ++i)
           {
-            const auto result = deps.insert(Index(x, y));
-            if (result.second)
-              collectDependencies(getCell(Index(x, y)), Index(x, y), deps);
+            Index const& idx = formulas[block + i].first;
+            Cell & cell = *formulas[block + i].second;
+
+            if (!cell.evaluated)
+              perf::stats().recalcCells++;
+
+            cell.evaluated = true;
+            cell.value = results[i];
+            showValue(cell);
+            store.set(idx.x, idx.y, cell.value);
           }
+        }
       }
+
+      start = end;
     }
   }
 
-  void evaluateCell(Cell & cell)
+  ValueStore const& values()
   {
-    cell.evaluated = true;
+    return currentBuffer().values_;
+  }
 
-    if (cell.hasExpression)
+  // Finds the circular references and the order to evaluate the formulas in, again only after
+  // the formulas changed
+  // True if a cell in the range [start, end] is in cells
+  static bool rangeContains(std::unordered_set<Index> const& cells, Index const& start, Index const& end)
+  {
+    const int64_t area = int64_t(end.x - start.x + 1) * (end.y - start.y + 1);
+
+    if (area > (int64_t)cells.size())
+    {
+      for (Index const& idx : cells)
+      {
+        if (idx.x >= start.x && idx.x <= end.x && idx.y >= start.y && idx.y <= end.y)
+          return true;
+      }
+    }
+    else
     {
-      cell.value = evaluate(cell.expression);
-      cell.display = str::fromDouble(cell.value);
+      for (int y = start.y; y <= end.y; ++y)
+        for (int x = start.x; x <= end.x; ++x)
+          if (cells.count(Index(x, y)))
+            return true;
     }
+
+    return false;
   }
 
-  void evaluateDocument()
+  // Finds the formulas that read a circular reference, directly or through other formulas.
+  // Unless the cycle is calculated iteratively they show CYCLE_DISPLAY as well.
+  static void findCycleDependents(Buffer & buffer)
   {
+    buffer.cycleDependents_.clear();
+    if (buffer.cyclic_.empty())
+      return;
+
+    std::unordered_set<Index> reached = buffer.cyclic_;
+    std::vector<std::pair<Index, Index>> refs;
+
+    // Every formula comes after the ones it reads, so one pass reaches all of them
+    for (Index const& idx : buffer.dependencies_.cells)
+    {
+      if (reached.count(idx))
+        continue;
+
+      refs.clear();
+      buffer.doc_.cells_.find(idx)->second.formula->references(idx, refs);
+
+      for (auto const& ref : refs)
+      {
+        if (rangeContains(reached, ref.first, ref.second))
+        {
+          reached.insert(idx);
+          buffer.cycleDependents_.insert(idx);
+          break;
+        }
+      }
+    }
+  }
+
+  static void analyzeDependencies()
+  {
+    Buffer & buffer = currentBuffer();
+    if (buffer.dependenciesValid_)
+      return;
+
+    TRACE_SCOPE("doc::analyzeDependencies");
+
+    std::vector<std::pair<Index, Formula const*>> formulas;
+    for (auto const& it : buffer.doc_.cells_)
+    {
+      if (it.second.hasExpression && it.second.formula && it.second.formula->valid())
+        formulas.push_back(std::make_pair(it.first, it.second.formula.get()));
+    }
+
+    buffer.dependencies_ = orderDependencies(formulas);
+    buffer.cyclic_.clear();
+
+    for (auto const& cycle : buffer.dependencies_.cycles)
+    {
+      for (int i = cycle.first; i < cycle.second; ++i)
+        buffer.cyclic_.insert(buffer.dependencies_.cells[i]);
+    }
+
+    findCycleDependents(buffer);
+    buffer.dependenciesValid_ = true;
+  }
+
+  // Evaluates the formulas of a circular reference, starting from 0, over and over until no
+  // value changes by more than ITERATION_TOLERANCE or for at most 'iterations' rounds
+  static void evaluateCycle(std::pair<int, int> const& cycle, int iterations)
+  {
+    Buffer & buffer = currentBuffer();
+    std::vector<Index> const& cells = buffer.dependencies_.cells;
+
+    for (int round = 0; round < iterations && !recalcStopped(); ++round)
+    {
+      double change = 0.0;
+
+      for (int i = cycle.first; i < cycle.second; ++i)
+      {
+        Cell & cell = *findCell(cells[i]);
+        const double value = cell.formula->evaluate(cells[i]);
+
+        change = std::max(change, std::fabs(value - cell.value));
+        cell.value = value;
+        buffer.values_.set(cells[i].x, cells[i].y, value);
+        perf::stats().recalcCells++;
+      }
+
+      if (change <= ITERATION_TOLERANCE)
+        break;
+    }
+
+    for (int i = cycle.first; i < cycle.second; ++i)
+      showValue(*findCell(cells[i]));
+  }
+
+  // Returns false if a background recalculation was cancelled before it finished
+  static bool evaluateBuffer(bool lazy, int iterations)
+  {
+    TRACE_SCOPE("doc::evaluateDocument");
+    ALLOC_SCOPE("recalc");
+
+    const int64_t start = perf::now();
+    perf::stats().recalcCells = 0;
+
+    currentBuffer().interrupted_ = false;
+
     Document & doc = currentDoc();
+    ValueStore & store = currentBuffer().values_;
+
+    std::vector<int> columnHeights(doc.width_, 0);
+    for (auto const& it : doc.cells_)
+    {
+      if (it.first.x >= 0 && it.first.x < doc.width_)
+        columnHeights[it.first.x] = std::max(columnHeights[it.first.x], it.first.y + 1);
+    }
+
+    store.reset(doc.width_, columnHeights);
+
+    analyzeDependencies();
+    std::unordered_set<Index> const& cyclic = currentBuffer().cyclic_;
+    std::unordered_set<Index> const& cycleDependents = currentBuffer().cycleDependents_;
+
+    std::vector<std::pair<Index, Cell *>> formulas;
 
     for (auto & it : doc.cells_)
     {
       const Index idx = it.first;
       Cell & cell = it.second;
 
-      cell.value = 0.0;
-
       if (cell.hasExpression)
       {
-        if (cell.expression.empty())
+        cell.value = 0.0;
+
+        if (!cell.formula || !cell.formula->valid())
+        {
+          setDisplay(cell, "#ERROR");
+          cell.evaluated = true;
+          store.set(idx.x, idx.y, cell.value, false);
+        }
+        else if (!cyclic.empty() && cyclic.count(idx))
         {
-          cell.display = "#ERROR";
+          // Evaluated by evaluateCycle(), or left as an error
+          setDisplay(cell, CYCLE_DISPLAY);
           cell.evaluated = true;
+          store.set(idx.x, idx.y, cell.value, iterations > 0);
+        }
+        else if (iterations == 0 && !cycleDependents.empty() && cycleDependents.count(idx))
+        {
+          // Reads a circular reference that is left as an error, so it is one too
+          setDisplay(cell, CYCLE_DISPLAY);
+          cell.evaluated = true;
+          store.set(idx.x, idx.y, cell.value, false);
         }
         else
         {
           cell.evaluated = false;
-          cell.display = "";
+          store.setPending(idx.x, idx.y);
+          formulas.push_back(std::make_pair(idx, &cell));
         }
       }
       else
       {
-        cell.display = cell.text;
+        showValue(cell);
         cell.evaluated = true;
+        store.set(idx.x, idx.y, cell.value, cell.number);
+      }
+    }
 
-        try {
-          cell.value = std::stod(cell.text);
-        } catch (std::exception) {
-        }
+    store.clearUnwritten();
+
+    if (iterations > 0)
+    {
+      for (auto const& cycle : currentBuffer().dependencies_.cycles)
+        evaluateCycle(cycle, iterations);
+    }
+
+    if (lazy)
+    {
+      // Cells are evaluated as they are drawn or read, and the rest by evaluatePending()
+      schedulePending();
+    }
+    else
+    {
+      evaluateColumnRuns(formulas);
+
+      // Whatever depends on a cell is evaluated after it, so evaluating one never recurses far
+      for (Index const& idx : currentBuffer().dependencies_.cells)
+      {
+        Cell & cell = *findCell(idx);
+        if (!cell.evaluated && !recalcStopped())
+          evaluateCell(idx, cell);
+      }
+
+      if (recalcStopped())
+      {
+        // The worker thread only stops when a newer edit cancelled it
+        if (recalcJob_)
+          return false;
+
+        interruptRecalc();
+      }
+      else
+      {
+        currentBuffer().pending_.clear();
+        currentBuffer().nextPending_ = 0;
       }
     }
 
-    for (auto & it : doc.cells_)
-      evaluateCell(it.second);
+    perf::stats().recalcTime = perf::elapsed(start);
+    return true;
+  }
+
+  void evaluateDocument()
+  {
+    cancelRecalc(currentBuffer());
+
+    RecalcBudget budget(RECALC_BUDGET.toInt());
+    evaluateBuffer(LAZY_EVALUATION.toBool(), iterationLimit());
+  }
+
+  bool recalc()
+  {
+    Buffer & buffer = currentBuffer();
+
+    if (buffer.interrupted_)
+    {
+      buffer.interrupted_ = false;
+      evaluatePending(-1.0);
+    }
+    else
+    {
+      cancelRecalc(buffer);
+
+      RecalcBudget budget(RECALC_BUDGET.toInt());
+      evaluateBuffer(false, iterationLimit());
+    }
+
+    return !buffer.interrupted_;
+  }
+
+  bool isInterrupted()
+  {
+    return currentBuffer().interrupted_;
+  }
+
+  bool applyRecalc()
+  {
+    std::vector<std::unique_ptr<RecalcJob>> finished;
+    {
+      RecalcWorker & worker = recalcWorker();
+      bx::MutexScope lock(worker.mutex_);
+      std::swap(finished, worker.finished_);
+    }
+
+    bool applied = false;
+
+    for (auto & job : finished)
+    {
+      auto buffer = std::find_if(documentBuffers().begin(), documentBuffers().end(), [&job](Buffer const& buffer) {
+        return buffer.id_ == job->bufferId_;
+      });
+
+      // The document was edited, recalculated or closed since the job was queued
+      if (buffer == documentBuffers().end() || buffer->version_ != job->version_)
+        continue;
+
+      for (auto const& it : job->buffer_.doc_.cells_)
+      {
+        auto cell = buffer->doc_.cells_.find(it.first);
+        if (cell == buffer->doc_.cells_.end())
+          continue;
+
+        cell->second.value = it.second.value;
+        cell->second.evaluated = true;
+        setDisplay(cell->second, it.second.display);
+      }
+
+      std::swap(buffer->values_, job->buffer_.values_);
+      buffer->stale_ = false;
+
+      if (!buffer->dependenciesValid_)
+      {
+        std::swap(buffer->dependencies_, job->buffer_.dependencies_);
+        std::swap(buffer->cyclic_, job->buffer_.cyclic_);
+        std::swap(buffer->cycleDependents_, job->buffer_.cycleDependents_);
+        buffer->dependenciesValid_ = job->buffer_.dependenciesValid_;
+      }
+
+      perf::stats().recalcTime = job->recalcTime_;
+      perf::stats().recalcCells = job->recalcCells_;
+      applied = true;
+    }
+
+    return applied;
+  }
+
+  bool isRecalculating()
+  {
+    for (Buffer const& buffer : documentBuffers())
+    {
+      if (buffer.stale_)
+        return true;
+    }
+
+    return false;
+  }
+
+  bool isCellStale(Index const& idx)
+  {
+    if (!currentBuffer().stale_)
+      return false;
+
+    Cell const* cell = findCell(idx);
+    return cell && cell->hasExpression;
+  }
+
+  bool hasPendingEvaluation()
+  {
+    return !currentBuffer().interrupted_ && currentBuffer().nextPending_ < currentBuffer().pending_.size();
+  }
+
+  bool evaluatePending(double budget)
+  {
+    TRACE_SCOPE("doc::evaluatePending");
+
+    Buffer & buffer = currentBuffer();
+    if (buffer.interrupted_)
+      return true;
+
+    const int64_t start = perf::now();
+    RecalcBudget recalcBudget(RECALC_BUDGET.toInt());
+
+    std::vector<std::pair<Index, Cell *>> formulas;
+
+    while (buffer.nextPending_ < buffer.pending_.size())
+    {
+      const std::size_t end = std::min(buffer.pending_.size(), buffer.nextPending_ + PENDING_CHUNK_SIZE);
+
+      // Cells that were drawn or read in the meantime are already evaluated
+      formulas.clear();
+      for (; buffer.nextPending_ < end; ++buffer.nextPending_)
+      {
+        Index const& idx = buffer.pending_[buffer.nextPending_];
+        Cell * cell = findCell(idx);
+
+        if (cell && !cell->evaluated)
+          formulas.push_back(std::make_pair(idx, cell));
+      }
+
+      evaluateColumnRuns(formulas);
+
+      for (auto & it : formulas)
+      {
+        if (!it.second->evaluated && !recalcStopped())
+          evaluateOnDemand(it.first, *it.second);
+      }
+
+      if (recalcStopped())
+      {
+        interruptRecalc();
+        return true;
+      }
+
+      if (budget >= 0.0 && perf::elapsed(start) >= budget)
+        break;
+    }
+
+    if (buffer.nextPending_ < buffer.pending_.size())
+      return true;
+
+    buffer.pending_.clear();
+    buffer.nextPending_ = 0;
+    return false;
   }
 
   std::string getCellText(Index const& idx)
@@ -805,20 +1745,54 @@ namespace doc {
     if (idx.x < 0 || idx.x >= currentDoc().width_ || idx.y < 0 || idx.y >= currentDoc().height_)
       return "";
 
-    Cell const& cell = currentDoc().cells_[idx];
-    return getText(cell);
+    Cell const* cell = findCell(idx);
+    return cell ? getText(*cell, idx) : "";
   }
 
   std::string getCellDisplayText(Index const& idx)
   {
-    if (!hasCell(idx))
+    Cell const* cell = findCell(idx);
+    if (!cell)
       return "";
 
-    Cell const& cell = currentDoc().cells_[idx];
+    if (cell->hasExpression && !cell->evaluated)
+      return PENDING_DISPLAY;
+
+    return displayText(*cell);
+  }
+
+  CellRender const* getCellRender(Index const& idx, int width)
+  {
+    auto it = currentDoc().cells_.find(idx);
+    if (it == currentDoc().cells_.end())
+      return nullptr;
+
+    Cell & cell = it->second;
+    CellRender & render = cell.render;
+
+    // Cells on screen are evaluated as soon as they are drawn
+    if (!cell.evaluated && !currentBuffer().interrupted_)
+    {
+      RecalcBudget budget(RECALC_BUDGET.toInt());
+      evaluateOnDemand(idx, cell);
+
+      if (recalcStopped())
+        interruptRecalc();
+    }
+
+    // A render of a number is also out of date once the cell holds another one
+    if (!render.valid || (showsValue(cell) && std::memcmp(&render.value, &cell.value, sizeof(double)) != 0))
+    {
+      str::toUTF32(displayText(cell), render.text);
+      render.value = cell.value;
+      render.width = -1;
+      render.valid = true;
+    }
+
+    if (render.width != width || render.format != cell.format)
+      layoutCellRender(render, width, cell.format);
 
-    if (cell.display.empty())
-      return getText(cell);
-    return cell.display;
+    return &render;
   }
 
   double getCellValue(Index const& idx)
@@ -826,11 +1800,25 @@ namespace doc {
     if (idx.x < 0 || idx.x >= currentDoc().width_ || idx.y < 0 || idx.y >= currentDoc().height_)
       return 0.0;
 
-    Cell & cell = currentDoc().cells_[idx];
-    if (!cell.evaluated)
-      evaluateCell(cell);
+    Cell * cell = findCell(idx);
+    if (!cell)
+      return 0.0;
+
+    if (!cell->evaluated && !currentBuffer().interrupted_)
+      evaluateOnDemand(idx, *cell);
 
-    return cell.value;
+    return cell->value;
+  }
+
+  void forEachCellValue(Index const& start, Index const& end, std::function<void(Index const&, double, bool)> const& func)
+  {
+    forEachCell(start, end, [&func](Index const& idx, Cell & cell) {
+      if (!cell.evaluated && !currentBuffer().interrupted_)
+        evaluateOnDemand(idx, cell);
+
+      // The same as the value store, errors and formulas that are still pending are not numbers
+      func(idx, cell.value, cell.number || showsValue(cell));
+    });
   }
 
   uint32_t getCellFormat(Index const& idx)
@@ -838,18 +1826,31 @@ namespace doc {
     if (idx.x < 0 || idx.x >= currentDoc().width_ || idx.y < 0 || idx.y >= currentDoc().height_)
       return 0;
 
-    Cell const& cell = currentDoc().cells_[idx];
-    return cell.format;
+    Cell const* cell = findCell(idx);
+    return cell ? cell->format : 0;
   }
 
   void setCellText(Index const& idx, std::string const& text)
   {
+    ALLOC_SCOPE("edit");
+
     if (currentDoc().readOnly_)
       return;
 
     takeUndoSnapshot(EditAction::CellText, false);
+
+    // Only formulas take part in the dependency graph
+    Cell const* cell = findCell(idx);
+    if (cell && cell->hasExpression)
+      currentBuffer().dependenciesValid_ = false;
+
     setText(idx, text);
-    evaluateDocument();
+    getCell(idx).evaluated = false;
+
+    if (getCell(idx).hasExpression)
+      currentBuffer().dependenciesValid_ = false;
+
+    recalculate();
   }
 
   void setCellFormat(Index const& idx, uint32_t format)
@@ -864,6 +1865,7 @@ namespace doc {
 
     Cell & cell = currentDoc().cells_[idx];
     cell.format = format;
+    cell.render.valid = false;
   }
 
   void increaseColumnWidth(int column)
@@ -874,7 +1876,7 @@ namespace doc {
     int width = getColumnWidth(column);
 
     takeUndoSnapshot(EditAction::ColumnWidth, true);
-    currentDoc().columnWidth_[column] = width + 1;
+    storeColumnWidth(column, width + 1);
   }
 
   void decreaseColumnWidth(int column)
@@ -887,12 +1889,36 @@ namespace doc {
     if (width > 3)
     {
       takeUndoSnapshot(EditAction::ColumnWidth, true);
-      currentDoc().columnWidth_[column] = width - 1;
+      storeColumnWidth(column, width - 1);
     }
   }
 
+  // Adjusts the references of a formula for a structural edit that moved its cell from 'from' to 'to'
+  static void moveFormula(Cell & cell, Index const& from, Index const& to, std::function<void (Index &)> const& moveReference)
+  {
+    if (!cell.hasExpression || !cell.formula || !cell.formula->valid())
+      return;
+
+    std::vector<Expr> expression = cell.formula->expression(from);
+
+    for (auto & expr : expression)
+    {
+      if (expr.type_ == Expr::Cell || expr.type_ == Expr::Range)
+      {
+        moveReference(expr.startIndex_);
+
+        if (expr.type_ == Expr::Range)
+          moveReference(expr.endIndex_);
+      }
+    }
+
+    cell.formula = Formula::intern(expression, to);
+  }
+
   void addColumn(int column)
   {
+    ALLOC_SCOPE("edit");
+
     column = std::min(column, currentDoc().width_ - 1);
 
     if (currentDoc().readOnly_)
@@ -902,31 +1928,46 @@ namespace doc {
 
     currentDoc().width_++;
 
+    std::unordered_map<int, int> newColumnWidth;
     std::unordered_map<Index, Cell> newCells;
 
+    // Move column info along with the cells
+    for (std::pair<int, int> col : currentDoc().columnWidth_)
+    {
+      if (col.first >= column)
+        col.first++;
+
+      newColumnWidth.insert(col);
+    }
+
     for (std::pair<Index, Cell> cell : currentDoc().cells_)
     {
+      const Index from = cell.first;
+
       if (cell.first.x >= column)
         cell.first.x++;
 
-      for (auto & expr : cell.second.expression)
-      {
-        if (expr.startIndex_.x >= column)
-          expr.startIndex_.x++;
+      cell.second.render.valid = false;
 
-        if (expr.endIndex_.x >= column)
-          expr.endIndex_.x++;
-      }
+      moveFormula(cell.second, from, cell.first, [column](Index & ref) {
+        if (ref.x >= column)
+          ref.x++;
+      });
 
       newCells.insert(cell);
     }
 
     currentDoc().cells_ = std::move(newCells);
-    evaluateDocument();
+    currentDoc().columnWidth_ = std::move(newColumnWidth);
+    columnLayout().insertColumn(column);
+    currentBuffer().dependenciesValid_ = false;
+    recalculate();
   }
 
   void addRow(int row)
   {
+    ALLOC_SCOPE("edit");
+
     row = std::min(row, currentDoc().height_ - 1);
 
     if (currentDoc().readOnly_)
@@ -940,27 +1981,30 @@ namespace doc {
 
     for (std::pair<Index, Cell> cell : currentDoc().cells_)
     {
+      const Index from = cell.first;
+
       if (cell.first.y > row)
         cell.first.y++;
 
-      for (auto & expr : cell.second.expression)
-      {
-        if (expr.startIndex_.y > row)
-          expr.startIndex_.y++;
+      cell.second.render.valid = false;
 
-        if (expr.endIndex_.y > row)
-          expr.endIndex_.y++;
-      }
+      moveFormula(cell.second, from, cell.first, [row](Index & ref) {
+        if (ref.y > row)
+          ref.y++;
+      });
 
       newCells.insert(cell);
     }
 
     currentDoc().cells_ = std::move(newCells);
-    evaluateDocument();
+    currentBuffer().dependenciesValid_ = false;
+    recalculate();
   }
 
   void removeColumn(int column)
   {
+    ALLOC_SCOPE("edit");
+
     if (currentDoc().readOnly_)
       return;
 
@@ -988,17 +2032,17 @@ namespace doc {
     {
       if (cell.first.x != column)
       {
+        const Index from = cell.first;
+
         if (cell.first.x > column)
           cell.first.x--;
 
-        for (auto & expr : cell.second.expression)
-        {
-          if (expr.startIndex_.x > column)
-            expr.startIndex_.x--;
+        cell.second.render.valid = false;
 
-          if (expr.endIndex_.x > column)
-            expr.endIndex_.x--;
-        }
+        moveFormula(cell.second, from, cell.first, [column](Index & ref) {
+          if (ref.x > column)
+            ref.x--;
+        });
 
         newCells.insert(cell);
       }
@@ -1006,11 +2050,15 @@ namespace doc {
 
     currentDoc().cells_ = std::move(newCells);
     currentDoc().columnWidth_ = std::move(newColumnWidth);
-    evaluateDocument();
+    columnLayout().removeColumn(column);
+    currentBuffer().dependenciesValid_ = false;
+    recalculate();
   }
 
   void removeRow(int row)
   {
+    ALLOC_SCOPE("edit");
+
     if (row < 0 || row >= getRowCount())
       return;
 
@@ -1027,24 +2075,45 @@ namespace doc {
     {
       if (cell.first.y != row)
       {
+        const Index from = cell.first;
+
         if (cell.first.y > row)
           cell.first.y--;
 
-      for (auto & expr : cell.second.expression)
-      {
-        if (expr.startIndex_.y > row)
-          expr.startIndex_.y--;
+        cell.second.render.valid = false;
 
-        if (expr.endIndex_.y > row)
-          expr.endIndex_.y--;
-      }
+        moveFormula(cell.second, from, cell.first, [row](Index & ref) {
+          if (ref.y > row)
+            ref.y--;
+        });
 
         newCells.insert(cell);
       }
     }
 
     currentDoc().cells_ = std::move(newCells);
-    evaluateDocument();
+    currentBuffer().dependenciesValid_ = false;
+    recalculate();
+  }
+
+  int compact()
+  {
+    auto & cells = currentDoc().cells_;
+    const std::size_t count = cells.size();
+
+    // Only cells that hold nothing are dropped, so the document reads the same afterwards
+    for (auto it = cells.begin(); it != cells.end(); )
+    {
+      if (it->second.text.empty() && it->second.format == 0)
+        it = cells.erase(it);
+      else
+        ++it;
+    }
+
+    // Give back the buckets of the dropped cells as well
+    cells.rehash(0);
+
+    return count - cells.size();
   }
 
   // -- Tcl bindings --
@@ -1205,6 +2274,16 @@ namespace doc {
     TCL_STRING_UTF8_RESULT(getCellText(idx));
   }
 
+  TCL_FUNC(recalc, "", "Continue a recalculation of the current document that ran out of time, or recalculate it, returns true when every cell is evaluated")
+  {
+    TCL_INT_RESULT(recalc());
+  }
+
+  TCL_FUNC(compact, "", "Drop the empty cells from the current document and return how many were dropped")
+  {
+    TCL_INT_RESULT(compact());
+  }
+
   TCL_FUNC(isReadOnly, "", "Returns true if the current document is read only")
   {
     TCL_INT_RESULT(isReadOnly() ? 1 : 0);
@@ -1330,11 +2409,26 @@ namespace doc {
       }
     }
 
+    // Rows are matched on their displayed values, so every cell has to be evaluated first
+    if (currentBuffer().stale_)
+      evaluateDocument();
+
+    // A recalculation that ran out of time gets another try before giving up
+    if (currentBuffer().interrupted_)
+      recalc();
+
+    if (evaluatePending(-1.0))
+    {
+      logError("could not filter, the recalculation ran out of time before every cell was evaluated, run recalc and try again");
+      return JIM_ERR;
+    }
+
     Document & doc = currentDoc();
     Buffer buffer;
 
     buffer.doc_.width_ = doc.width_;
     buffer.doc_.columnWidth_ = doc.columnWidth_;
+    buffer.doc_.columnLayout_ = doc.columnLayout_;
     buffer.doc_.delimiter_ = doc.delimiter_;
     buffer.doc_.filename_ = "[No Name]";
     buffer.doc_.readOnly_ = false;
@@ -1342,7 +2436,11 @@ namespace doc {
     if (copyHeader)
     {
       for (int i = 0; i < doc.width_; ++i)
-        buffer.doc_.cells_[Index(i, 0)] = doc.cells_[Index(i, 0)];
+      {
+        Cell const* cell = findCell(Index(i, 0));
+        if (cell)
+          buffer.doc_.cells_[Index(i, 0)] = copyCell(*cell, Index(i, 0), Index(i, 0));
+      }
     }
 
     int row = copyHeader ? 1 : 0;
@@ -1384,22 +2482,28 @@ namespace doc {
 
           case FilterOp::Greater:
             {
-              try {
-                include &= std::stod(text) > std::stod(value);
-              } catch (std::exception e) {
+              double lhs, rhs;
+              if (!str::parseNumber(text, lhs) || !str::parseNumber(value, rhs))
+              {
                 logError("could not make comparison ", text, " > ", value);
                 return JIM_ERR;
               }
+
+              include &= lhs > rhs;
             }
             break;
 
           case FilterOp::LessThan:
-              try {
-                include &= std::stod(text) < std::stod(value);
-              } catch (std::exception e) {
+            {
+              double lhs, rhs;
+              if (!str::parseNumber(text, lhs) || !str::parseNumber(value, rhs))
+              {
                 logError("could not make comparison ", text, " < ", value);
                 return JIM_ERR;
               }
+
+              include &= lhs < rhs;
+            }
             break;
         }
       }
@@ -1407,7 +2511,11 @@ namespace doc {
       if (include)
       {
         for (int i = 0; i < doc.width_; ++i)
-          buffer.doc_.cells_[Index(i, row)] = doc.cells_[Index(i, y)];
+        {
+          Cell const* cell = findCell(Index(i, y));
+          if (cell)
+            buffer.doc_.cells_[Index(i, row)] = copyCell(*cell, Index(i, y), Index(i, row));
+        }
         ++row;
       }
     }
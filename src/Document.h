@@ -3,6 +3,9 @@
 
 #include "Cell.h"
 #include "Index.h"
+#include "ValueStore.h"
+
+#include <functional>
 
 namespace doc {
 
@@ -30,6 +33,10 @@ namespace doc {
   int getColumnWidth(int column);
   void setColumnWidth(int column, int width);
 
+  // Returns the x offset of a column relative to the first column, and the column at an offset
+  int getColumnOffset(int column);
+  int getColumnAt(int x);
+
   int getRowCount();
   int getColumnCount();
   bool isReadOnly();
@@ -47,11 +54,40 @@ namespace doc {
 
   void evaluateDocument();
 
+  // With doc_lazyEvaluation set evaluateDocument() leaves the formulas to be evaluated as they
+  // are drawn or read. The rest are evaluated here, for at most 'budget' milliseconds or until
+  // all are done if the budget is negative. Returns true if there are still cells left.
+  bool evaluatePending(double budget);
+  bool hasPendingEvaluation();
+
+  // A recalculation that runs for longer than doc_recalcBudget milliseconds stops, leaving the
+  // formulas it did not get to as not evaluated. They are not evaluated as they are drawn or read
+  // until recalc() continues with them. Without an interrupted recalculation recalc() evaluates
+  // the whole document, lazy evaluation or not. Returns true if every cell is evaluated.
+  bool recalc();
+  bool isInterrupted();
+
+  // With doc_backgroundRecalc set edits recalculate a copy of the document on a worker thread,
+  // a newer edit cancels the recalculation in flight. Until the results are applied the cells
+  // keep showing their previous values, and the formulas are stale. Returns true if the results
+  // of a finished recalculation were applied.
+  bool applyRecalc();
+  bool isRecalculating();
+  bool isCellStale(Index const& idx);
+
   std::string getCellText(Index const& idx);
   std::string getCellDisplayText(Index const& idx);
+  CellRender const* getCellRender(Index const& idx, int width);
   uint32_t getCellFormat(Index const& idx);
   double getCellValue(Index const& idx);
 
+  // Calls func with the value of every non-empty cell in the range [start, end], and if the
+  // cell holds a number. Reading cells, here or through the functions above, never creates them.
+  void forEachCellValue(Index const& start, Index const& end, std::function<void(Index const&, double, bool)> const& func);
+
+  // Values of the current document by position, filled in by evaluateDocument()
+  ValueStore const& values();
+
   void setCellText(Index const& idx, std::string const& text);
   void setCellFormat(Index const& idx, uint32_t format);
 
@@ -62,4 +98,7 @@ namespace doc {
   void addRow(int row);
   void removeColumn(int column);
   void removeRow(int row);
+
+  // Drops the cells without text or format from the current document, returns how many were dropped
+  int compact();
 }
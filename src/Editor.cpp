@@ -4,6 +4,9 @@
 #include "Str.h"
 #include "Commands.h"
 #include "Completion.h"
+#include "Perf.h"
+#include "Trace.h"
+#include "Alloc.h"
 #include "Tcl.h"
 
 #include <memory.h>
@@ -53,12 +56,13 @@ static std::vector<std::string> completionHints_;
 static std::vector<std::string> messageLines_;
 
 static const tcl::Variable ALWAYS_SHOW_HEADER("app_alwaysShowHeader", false);
+static const tcl::Variable SHOW_PERF_HUD("app_showPerfHud", false);
 
 extern void clearTimeout();
 
 static int getCommandLineHeight()
 {
-  return 2 + messageLines_.size();
+  return 2 + messageLines_.size() + (SHOW_PERF_HUD.toBool() ? 1 : 0);
 }
 
 void updateCursor()
@@ -88,19 +92,10 @@ static void ensureCursorVisibility()
   if ((doc::cursorPos().y - (ALWAYS_SHOW_HEADER.toBool() ? 1 : 0)) < doc::scroll().y)
     doc::scroll().y = doc::cursorPos().y - (ALWAYS_SHOW_HEADER.toBool() && doc::cursorPos().y != 0 ? 1 : 0);
 
-  int width = ROW_HEADER_WIDTH;
-  bool scroll = false;
-  for (int i = doc::scroll().x; i <= doc::cursorPos().x && !scroll; ++i)
-  {
-    width += doc::getColumnWidth(i);
-
-    while (width >= view::width())
-    {
-      scroll = true;
-      width -= doc::getColumnWidth(doc::scroll().x);
-      doc::scroll().x++;
-    }
-  }
+  // Scroll right until the right edge of the cursor column is inside the view
+  const int right = doc::getColumnOffset(doc::cursorPos().x + 1) + ROW_HEADER_WIDTH - view::width();
+  if (right >= doc::getColumnOffset(doc::scroll().x))
+    doc::scroll().x = std::min(doc::cursorPos().x, doc::getColumnAt(right) + 1);
 
   while ((doc::cursorPos().y - doc::scroll().y) >= (view::height() - 3))
     doc::scroll().y++;
@@ -672,6 +667,20 @@ void drawText(int x, int y, int length, uint16_t fg, uint16_t bg, std::string co
   }
 }
 
+static void drawCell(int x, int y, uint16_t fg, uint16_t bg, CellRender const& render)
+{
+  uint16_t style = fg;
+  if (render.format & FONT_BOLD)
+    style |= view::COLOR_BOLD;
+  if (render.format & FONT_UNDERLINE)
+    style |= view::COLOR_UNDERLINE;
+
+  const int end = render.start + render.length;
+
+  for (int i = 0; i < render.width; ++i)
+    view::changeCell(x + i, y, render.line[i], i >= render.start && i < end ? style : fg, bg);
+}
+
 void calculateColumDrawWidths()
 {
   drawColumnInfo_.clear();
@@ -759,6 +768,11 @@ void setCompletionHints(std::vector<std::string> const& hints)
 
 void drawInterface()
 {
+  TRACE_SCOPE("drawInterface");
+  ALLOC_SCOPE("frame");
+
+  const int64_t frameStart = perf::now();
+
   calculateColumDrawWidths();
 
   view::setClearAttributes(view::COLOR_DEFAULT, view::COLOR_DEFAULT);
@@ -768,7 +782,15 @@ void drawInterface()
   drawWorkspace();
 
   drawCommandLine();
-  view::present();
+
+  const int64_t presentStart = perf::now();
+  {
+    TRACE_SCOPE("view::present");
+    view::present();
+  }
+
+  perf::stats().presentTime = perf::elapsed(presentStart);
+  perf::stats().frameTime = perf::elapsed(frameStart);
 }
 
 void drawHeaders()
@@ -830,8 +852,12 @@ void drawWorkspace()
           bg = view::COLOR_SELECTION;
       }
 
-      const uint16_t fg = bg == view::COLOR_HIGHLIGHT ? view::COLOR_WHITE : view::COLOR_TEXT;
-      const int width = doc::getColumnWidth(drawColumnInfo_[x].column_);
+      const int width = drawColumnInfo_[x].width_;
+
+      // Formulas still show their previous values while the document is recalculated
+      uint16_t fg = bg == view::COLOR_HIGHLIGHT ? view::COLOR_WHITE : view::COLOR_TEXT;
+      if (doc::isCellStale(Index(drawColumnInfo_[x].column_, row)))
+        fg = view::COLOR_STALE;
 
       //if (row < doc::getRowCount())
       {
@@ -839,16 +865,12 @@ void drawWorkspace()
           drawText(drawColumnInfo_[x].x_, y, width, fg, bg, editLine_.utf8());
         else
         {
-          std::string cellText = doc::getCellDisplayText(Index(drawColumnInfo_[x].column_, row));
-          const uint32_t format = doc::getCellFormat(Index(drawColumnInfo_[x].column_, row));
-
-          if (cellText.size() >= width)
-          {
-            cellText = cellText.substr(0, width - 3);
-            cellText.append(2, '.').append(1, ' ');
-          }
+          CellRender const* render = doc::getCellRender(Index(drawColumnInfo_[x].column_, row), width);
 
-          drawText(drawColumnInfo_[x].x_, y, width, fg, bg, cellText, format);
+          if (render)
+            drawCell(drawColumnInfo_[x].x_, y, fg, bg, *render);
+          else
+            drawText(drawColumnInfo_[x].x_, y, width, fg, bg, "");
         }
       }
     }
@@ -914,6 +936,18 @@ void drawCommandLine()
             .append(1, ' ');
   }
 
+  if (SHOW_PERF_HUD.toBool())
+  {
+    perf::Stats const& stats = perf::stats();
+
+    char hud[256];
+    snprintf(hud, sizeof(hud), " frame %.2fms  present %.2fms  recalc %.2fms (%d cells)  load %.1fMB/s  save %.1fMB/s",
+             stats.frameTime, stats.presentTime, stats.recalcTime, stats.recalcCells,
+             perf::throughput(stats.loadBytes, stats.loadTime), perf::throughput(stats.saveBytes, stats.saveTime));
+
+    drawText(0, view::height() - messageLines_.size() - 3, view::width(), view::COLOR_TEXT, view::COLOR_PANEL, hud);
+  }
+
   for (int i = 0; i < messageLines_.size(); ++i)
     drawText(0, view::height() - 1 - messageLines_.size() + i, view::width(), view::COLOR_TEXT, view::COLOR_SELECTION, messageLines_[i]);
 
@@ -5,6 +5,8 @@
 #include "Editor.h"
 #include "Log.h"
 #include "Tcl.h"
+#include "Trace.h"
+#include "Aggregate.h"
 
 #include <unordered_map>
 #include <cmath>
@@ -44,8 +46,8 @@ static const std::unordered_map<std::string, FuncDef> functionDefinitions_ = {
   { "-", FuncDef(1, 2, "-", opSubtract) },
 
   { "SUM",    FuncDef(-1, 1, "SUM",   funcSum) },
-  { "MIN",    FuncDef(-1, 1, "MIN",   funcMin) },
-  { "MAX",    FuncDef(-1, 1, "MAX",   funcMax) },
+  { "MIN",    FuncDef(-1, 2, "MIN",   funcMin) },
+  { "MAX",    FuncDef(-1, 2, "MAX",   funcMax) },
   { "ABS",    FuncDef(-1, 1, "ABS",   funcAbs) },
   { "COS",    FuncDef(-1, 1, "COS",   funcCos) },
   { "SIN",    FuncDef(-1, 1, "SIN",   funcSin) },
@@ -53,8 +55,33 @@ static const std::unordered_map<std::string, FuncDef> functionDefinitions_ = {
   { "CEIL",   FuncDef(-1, 1, "CEIL",  funcCeil) },
 };
 
+// Functions that also take a single range argument, used instead of the definition above when called with one argument
+static const std::unordered_map<std::string, FuncDef> rangeFunctionDefinitions_ = {
+  { "MIN",      FuncDef(-1, 1, "MIN",     funcMinRange) },
+  { "MAX",      FuncDef(-1, 1, "MAX",     funcMaxRange) },
+  { "AVERAGE",  FuncDef(-1, 1, "AVERAGE", funcAverage) },
+  { "COUNT",    FuncDef(-1, 1, "COUNT",   funcCount) },
+};
+
 static const int MAX_PRECEDENCE = 99999;
 
+// Looks up an operator or function, argCount selects the range form of a function and is -1 if it is not known
+static FuncDef const* findFunction(std::string const& name, int argCount)
+{
+  auto range = rangeFunctionDefinitions_.find(name);
+  if (argCount == 1 && range != rangeFunctionDefinitions_.end())
+    return &range->second;
+
+  auto it = functionDefinitions_.find(name);
+  if (it != functionDefinitions_.end())
+    return &it->second;
+
+  if (range != rangeFunctionDefinitions_.end())
+    return &range->second;
+
+  return nullptr;
+}
+
 bool opToString(FuncDef const* func, std::vector<std::tuple<int, std::string>> & args)
 {
   if (func->argCount_ != 2 || args.size() < 2)
@@ -71,7 +98,8 @@ bool opToString(FuncDef const* func, std::vector<std::tuple<int, std::string>> &
   if (aPrecedence < func->precedence_)
     aValue = "(" + aValue + ")";
 
-  if (bPrecedence < func->precedence_)
+  // Operators are left associative, so a right operand of the same precedence needs parentheses to parse back the same way
+  if (bPrecedence <= func->precedence_)
     bValue = "(" + bValue + ")";
 
   args.push_back(std::make_tuple(func->precedence_, aValue + " " + func->name_ + " " + bValue));
@@ -85,15 +113,17 @@ bool funcToString(FuncDef const* func, std::vector<std::tuple<int, std::string>>
 
   std::string result = func->name_ + std::string("(");
 
+  // The arguments are on the stack in the order they were written
+  const std::size_t first = args.size() - func->argCount_;
   for (int i = 0; i < func->argCount_; ++i)
   {
-    result += std::get<1>(args.back());
-    args.pop_back();
+    result += std::get<1>(args[first + i]);
 
     if (i < (func->argCount_ - 1))
       result += ", ";
   }
 
+  args.resize(first);
   result += ")";
   args.push_back(std::make_tuple(MAX_PRECEDENCE, result));
 
@@ -116,9 +146,31 @@ std::string exprToString(std::vector<Expr> const& expression)
     }
   }
 
+  if (result.empty())
+    return "";
+
   return std::get<1>(result.front());
 }
 
+void offsetReferences(std::vector<Expr> & expression, int dx, int dy)
+{
+  for (auto & expr : expression)
+  {
+    if (expr.type_ == Expr::Cell || expr.type_ == Expr::Range)
+    {
+      expr.startIndex_ = Index(expr.startIndex_.x + dx, expr.startIndex_.y + dy);
+
+      if (expr.type_ == Expr::Range)
+        expr.endIndex_ = Index(expr.endIndex_.x + dx, expr.endIndex_.y + dy);
+    }
+  }
+}
+
+int Expr::argCount() const
+{
+  return type_ == Function ? func_->argCount_ : 0;
+}
+
 std::string Expr::toStr() const
 {
   switch (type_)
@@ -162,11 +214,16 @@ static void printExpr(std::vector<Expr> const& output)
 
 std::vector<Expr> parseExpression(std::string const& source)
 {
+  TRACE_SCOPE("parseExpression");
+
   std::vector<Expr> output;
 
   std::vector<std::tuple<Token, std::string>> operatorStack;
   operatorStack.reserve(10);
 
+  // Number of arguments for every open parenthesis, 0 if it only groups an expression
+  std::vector<int> argCounts;
+
   Tokenizer tokenizer(source);
 
   bool cont = true;
@@ -177,32 +234,34 @@ std::vector<Expr> parseExpression(std::string const& source)
     switch (token)
     {
       case Token::Number:
-        output.push_back(Expr(std::stof(tokenizer.value().c_str())));
+        output.push_back(Expr(str::toDouble(tokenizer.value().data, tokenizer.value().size)));
         break;
 
       case Token::Cell:
-        output.push_back(Expr(Index::fromStr(tokenizer.value())));
+        output.push_back(Expr(Index::fromStr(tokenizer.value().data, tokenizer.value().size)));
         break;
 
       case Token::Range:
         {
-          const std::size_t pos = tokenizer.value().find_first_of(":");
-          if (pos == std::string::npos)
+          const TokenText range = tokenizer.value();
+          const uint32_t pos = range.find(':');
+          if (pos == range.size)
           {
-            logError("error in expression '", source, "' - malformated range '", tokenizer.value(), "'");
+            logError("error in expression '", source, "' - malformated range '", range.str(), "'");
             return {};
           }
 
-          const std::string start = tokenizer.value().substr(0, pos);
-          const std::string end = tokenizer.value().substr(pos + 1);
+          const TokenText start = range.substr(0, pos);
+          const TokenText end = range.substr(pos + 1);
 
-          output.push_back(Expr(Index::fromStr(start), Index::fromStr(end)));
+          output.push_back(Expr(Index::fromStr(start.data, start.size), Index::fromStr(end.data, end.size)));
         }
         break;
 
       case Token::Operator:
         {
-          FuncDef const& tokenDef = functionDefinitions_.at(tokenizer.value());
+          const std::string name = tokenizer.value().str();
+          FuncDef const& tokenDef = functionDefinitions_.at(name);
 
           while (!operatorStack.empty())
           {
@@ -224,25 +283,27 @@ std::vector<Expr> parseExpression(std::string const& source)
               break;
           }
 
-          operatorStack.push_back(std::make_tuple(Token::Operator, tokenizer.value()));
+          operatorStack.push_back(std::make_tuple(Token::Operator, name));
         }
         break;
 
       case Token::Identifier:
         {
-          if (functionDefinitions_.count(tokenizer.value()) == 1)
+          const std::string name = tokenizer.value().str();
+          if (findFunction(name, -1))
           {
-            operatorStack.push_back(std::make_tuple(Token::Identifier, tokenizer.value()));
+            operatorStack.push_back(std::make_tuple(Token::Identifier, name));
           }
           else
           {
-            logError("unknown function in expression '", source, "' - ", tokenizer.value());
+            logError("unknown function in expression '", source, "' - ", name);
             return {};
           }
         }
         break;
 
       case Token::LeftParenthesis:
+        argCounts.push_back(!operatorStack.empty() && std::get<0>(operatorStack.back()) == Token::Identifier ? 1 : 0);
         operatorStack.push_back(std::make_tuple(Token::LeftParenthesis, ""));
         break;
 
@@ -279,6 +340,9 @@ std::vector<Expr> parseExpression(std::string const& source)
             return {};
           }
 
+          const int argCount = argCounts.back();
+          argCounts.pop_back();
+
           if (!operatorStack.empty())
           {
             Token opToken;
@@ -287,9 +351,7 @@ std::vector<Expr> parseExpression(std::string const& source)
 
             if (opToken == Token::Identifier)
             {
-              FuncDef const& stackDef = functionDefinitions_.at(opValue);
-              output.push_back(Expr(&stackDef));
-
+              output.push_back(Expr(findFunction(opValue, argCount)));
               operatorStack.pop_back();
             }
           }
@@ -318,7 +380,7 @@ std::vector<Expr> parseExpression(std::string const& source)
             {
               case Token::Operator:
               case Token::Identifier:
-                output.push_back(Expr(&functionDefinitions_.at(opValue)));
+                output.push_back(Expr(findFunction(opValue, -1)));
                 break;
 
               default:
@@ -332,6 +394,8 @@ std::vector<Expr> parseExpression(std::string const& source)
             logError("error in expression '", source, "' - missplaced parenthesis or comma");
             return {};
           }
+
+          argCounts.back()++;
         }
         break;
 
@@ -340,7 +404,7 @@ std::vector<Expr> parseExpression(std::string const& source)
         break;
 
       case Token::Error:
-        logError("parse error in expression '", source, "' - ", tokenizer.value());
+        logError("parse error in expression '", source, "' - ", tokenizer.value().str());
         return {};
     };
   }
@@ -356,7 +420,7 @@ std::vector<Expr> parseExpression(std::string const& source)
     {
       case Token::Operator:
       case Token::Identifier:
-        output.push_back(Expr(&functionDefinitions_.at(opValue)));
+        output.push_back(Expr(findFunction(opValue, -1)));
         break;
 
       case Token::LeftParenthesis:
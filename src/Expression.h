@@ -4,6 +4,8 @@
 #include "Index.h"
 
 #include <string>
+#include <vector>
+#include <memory>
 
 struct FuncDef;
 
@@ -26,6 +28,9 @@ struct Expr
   std::string toStr() const;
   double toDouble() const;
 
+  // Number of arguments a function takes
+  int argCount() const;
+
   Type type_ = Type::Constant;
 
   union {
@@ -42,57 +47,6 @@ std::vector<Expr> parseExpression(std::string const& source);
 double evaluate(std::vector<Expr> const& expr);
 std::string exprToString(std::vector<Expr> const& expr);
 
+// Moves all cell and range references in the expression by dx columns and dy rows
+void offsetReferences(std::vector<Expr> & expression, int dx, int dy);
 
-namespace exp {
-
-  class Expr
-  {
-    public:
-      virtual double evaluate() const = 0;
-  };
-
-  class Constant : Expr
-  {
-    public:
-      double evaluate() const { return value_; }
-
-    private:
-      double value_ = 0.0;
-  };
-
-  class Cell : Expr
-  {
-    public:
-      virtual std::vector<Index> indices() const = 0;
-  };
-
-  class CellRef : Cell
-  {
-    public:
-  };
-
-  class CellRange : Cell
-  {
-    public:
-  };
-
-  class Function : Expr
-  {
-    public:
-      Function(std::vector<std::unique_ptr<Expr>> && args)
-        : arguments_(std::move(args))
-      { }
-
-    private:
-      std::vector<std::unique_ptr<Expr>> arguments_;
-  };
-
-  class BinaryOp : Expr
-  {
-    public:
-
-    private:
-      std::unique_ptr<Expr> leftHandSide_;
-      std::unique_ptr<Expr> rightHandSide_;
-  };
-}
\ No newline at end of file
@@ -45,19 +45,18 @@ static bool opSubtract(std::vector<Expr> & valueStack)
   RESULT(a - b);
 }
 
-static bool funcSum(std::vector<Expr> & valueStack)
+// Pops the range argument of a range function, and checks that it is valid
+static bool popRange(std::vector<Expr> & valueStack, const char * name, Index & startIdx, Index & endIdx)
 {
-  CHECK_ARG(1, "SUM(range)");
-
   const Expr range = popExpr(valueStack);
   if (range.type_ != Expr::Range)
   {
-    logError("sum function expected range argument");
+    logError(name, " function expected range argument");
     return false;
   }
 
-  Index const& startIdx = range.startIndex_;
-  Index const& endIdx = range.endIndex_;
+  startIdx = range.startIndex_;
+  endIdx = range.endIndex_;
 
   if (startIdx.x > endIdx.x || startIdx.y > endIdx.y)
   {
@@ -65,12 +64,62 @@ static bool funcSum(std::vector<Expr> & valueStack)
     return false;
   }
 
-  double sum = 0.0;
-  for (int y = startIdx.y; y <= endIdx.y; ++y)
-    for (int x = startIdx.x; x <= endIdx.x; ++x)
-      sum += doc::getCellValue(Index(x, y));
+  return true;
+}
+
+static bool funcSum(std::vector<Expr> & valueStack)
+{
+  CHECK_ARG(1, "SUM(range)");
+
+  Index startIdx, endIdx;
+  if (!popRange(valueStack, "sum", startIdx, endIdx))
+    return false;
+
+  RESULT(aggregateRange(Aggregate::Sum, startIdx, endIdx));
+}
+
+static bool funcMinRange(std::vector<Expr> & valueStack)
+{
+  CHECK_ARG(1, "MIN(range)");
+
+  Index startIdx, endIdx;
+  if (!popRange(valueStack, "min", startIdx, endIdx))
+    return false;
+
+  RESULT(aggregateRange(Aggregate::Min, startIdx, endIdx));
+}
+
+static bool funcMaxRange(std::vector<Expr> & valueStack)
+{
+  CHECK_ARG(1, "MAX(range)");
+
+  Index startIdx, endIdx;
+  if (!popRange(valueStack, "max", startIdx, endIdx))
+    return false;
+
+  RESULT(aggregateRange(Aggregate::Max, startIdx, endIdx));
+}
 
-  RESULT(sum);
+static bool funcAverage(std::vector<Expr> & valueStack)
+{
+  CHECK_ARG(1, "AVERAGE(range)");
+
+  Index startIdx, endIdx;
+  if (!popRange(valueStack, "average", startIdx, endIdx))
+    return false;
+
+  RESULT(aggregateRange(Aggregate::Average, startIdx, endIdx));
+}
+
+static bool funcCount(std::vector<Expr> & valueStack)
+{
+  CHECK_ARG(1, "COUNT(range)");
+
+  Index startIdx, endIdx;
+  if (!popRange(valueStack, "count", startIdx, endIdx))
+    return false;
+
+  RESULT(aggregateRange(Aggregate::Count, startIdx, endIdx));
 }
 
 static bool funcMin(std::vector<Expr> & valueStack)
@@ -80,7 +129,7 @@ static bool funcMin(std::vector<Expr> & valueStack)
   const double b = popExpr(valueStack).toDouble();
   const double a = popExpr(valueStack).toDouble();
 
-  RESULT(std::max(a, b));
+  RESULT(std::min(a, b));
 }
 
 static bool funcMax(std::vector<Expr> & valueStack)
@@ -90,7 +139,7 @@ static bool funcMax(std::vector<Expr> & valueStack)
   const double b = popExpr(valueStack).toDouble();
   const double a = popExpr(valueStack).toDouble();
 
-  RESULT(std::min(a, b));
+  RESULT(std::max(a, b));
 }
 
 static bool funcAbs(std::vector<Expr> & valueStack)
@@ -0,0 +1,277 @@
+
+#include "Formula.h"
+#include "Tokenizer.h"
+#include "Str.h"
+#include "Tcl.h"
+
+#include <unordered_map>
+#include <algorithm>
+
+struct FormulaKeyHash
+{
+  std::size_t operator()(std::string const& key) const { return str::hash(key); }
+};
+
+typedef std::unordered_map<std::string, std::weak_ptr<const Formula>, FormulaKeyHash> FormulaCache;
+
+static FormulaCache formulaCache_;
+
+// Expired entries are removed when the cache has grown to twice the size it had after the last sweep
+static std::size_t sweepSize_ = 64;
+
+// Recently parsed formulas are kept alive even when no cell holds them any more, so text that
+// comes back after its cells were gone, from undo, paste or reloading a file, is not parsed
+// again. Each key has one slot, a newer formula in the same slot drops the older one.
+static const std::size_t RECENT_FORMULAS = 4096;
+
+static std::vector<std::shared_ptr<const Formula>> recentFormulas_(RECENT_FORMULAS);
+
+struct FormulaCacheStats
+{
+  long long hits = 0;
+  long long misses = 0;
+};
+
+static FormulaCacheStats cacheStats_;
+
+static void appendOffset(std::string & key, Index const& ref, Index const& idx)
+{
+  key += std::to_string(ref.x - idx.x);
+  key += ',';
+  key += std::to_string(ref.y - idx.y);
+  key += ';';
+}
+
+// Builds the cache key straight from the tokens, so a formula that is already cached is never parsed
+static std::string relativeKey(std::string const& source, Index const& idx)
+{
+  std::string key;
+  key.reserve(source.size() + 16);
+
+  Tokenizer tokenizer(source);
+
+  while (!tokenizer.eof())
+  {
+    const Token token = tokenizer.next();
+    key += (char)('a' + (int)token);
+
+    switch (token)
+    {
+      case Token::Cell:
+        appendOffset(key, Index::fromStr(tokenizer.value().data, tokenizer.value().size), idx);
+        break;
+
+      case Token::Range:
+        {
+          const TokenText range = tokenizer.value();
+          const uint32_t pos = range.find(':');
+          if (pos == range.size)
+          {
+            key.append(range.data, range.size);
+          }
+          else
+          {
+            const TokenText start = range.substr(0, pos);
+            const TokenText end = range.substr(pos + 1);
+            appendOffset(key, Index::fromStr(start.data, start.size), idx);
+            appendOffset(key, Index::fromStr(end.data, end.size), idx);
+          }
+        }
+        break;
+
+      default:
+        key.append(tokenizer.value().data, tokenizer.value().size);
+        key += ';';
+        break;
+    }
+
+    if (token == Token::EndOfFile || token == Token::Error)
+      break;
+  }
+
+  return key;
+}
+
+// Builds the cache key of an expression with its references resolved for the cell idx. These keys
+// start with '#', so they never match a key built from text.
+static std::string relativeKey(std::vector<Expr> const& expression, Index const& idx)
+{
+  std::string key = "#";
+
+  for (Expr const& expr : expression)
+  {
+    key += (char)('a' + (int)expr.type_);
+
+    switch (expr.type_)
+    {
+      case Expr::Cell:
+        appendOffset(key, expr.startIndex_, idx);
+        break;
+
+      case Expr::Range:
+        appendOffset(key, expr.startIndex_, idx);
+        appendOffset(key, expr.endIndex_, idx);
+        break;
+
+      case Expr::Function:
+        key += expr.toStr();
+        key += ',';
+        key += std::to_string(expr.argCount());
+        key += ';';
+        break;
+
+      case Expr::Constant:
+        // The shortest form that reads back as the same double, so every constant has its own key
+        key += expr.toStr();
+        key += ';';
+        break;
+    }
+  }
+
+  return key;
+}
+
+static std::shared_ptr<const Formula> findCached(std::string const& key)
+{
+  auto it = formulaCache_.find(key);
+  if (it != formulaCache_.end())
+  {
+    if (std::shared_ptr<const Formula> formula = it->second.lock())
+    {
+      cacheStats_.hits++;
+      return formula;
+    }
+  }
+
+  cacheStats_.misses++;
+  return nullptr;
+}
+
+static void sweepCache()
+{
+  for (auto it = formulaCache_.begin(); it != formulaCache_.end(); )
+  {
+    if (it->second.expired())
+      it = formulaCache_.erase(it);
+    else
+      ++it;
+  }
+
+  sweepSize_ = std::max<std::size_t>(64, formulaCache_.size() * 2);
+}
+
+std::shared_ptr<const Formula> Formula::intern(std::string const& source, Index const& idx)
+{
+  const std::string key = relativeKey(source, idx);
+
+  if (std::shared_ptr<const Formula> formula = findCached(key))
+    return formula;
+
+  return create(key, parseExpression(source), idx);
+}
+
+std::shared_ptr<const Formula> Formula::intern(std::vector<Expr> const& expression, Index const& idx)
+{
+  const std::string key = relativeKey(expression, idx);
+
+  if (std::shared_ptr<const Formula> formula = findCached(key))
+    return formula;
+
+  return create(key, expression, idx);
+}
+
+std::shared_ptr<const Formula> Formula::create(std::string const& key, std::vector<Expr> const& expression, Index const& idx)
+{
+  std::shared_ptr<Formula> formula = std::make_shared<Formula>();
+  formula->expression_ = expression;
+
+  offsetReferences(formula->expression_, -idx.x, -idx.y);
+
+  if (formula->valid())
+    formula->program_ = Program::compile(formula->expression_, idx);
+
+  if (formulaCache_.size() >= sweepSize_)
+    sweepCache();
+
+  formulaCache_[key] = formula;
+  recentFormulas_[str::hash(key) % RECENT_FORMULAS] = formula;
+  return formula;
+}
+
+std::vector<Expr> Formula::expression(Index const& idx) const
+{
+  std::vector<Expr> expression = expression_;
+
+  offsetReferences(expression, idx.x, idx.y);
+  return expression;
+}
+
+double Formula::evaluate(Index const& idx) const
+{
+  if (program_.fallback())
+    return ::evaluate(expression(idx));
+
+  return program_.execute(idx);
+}
+
+bool Formula::evaluateBlock(Index const& idx, int count, double * results) const
+{
+  return program_.executeBlock(idx, count, results);
+}
+
+void Formula::references(Index const& idx, std::vector<std::pair<Index, Index>> & refs) const
+{
+  for (Expr const& expr : expression_)
+  {
+    if (expr.type_ == Expr::Cell)
+    {
+      const Index ref(expr.startIndex_.x + idx.x, expr.startIndex_.y + idx.y);
+      refs.push_back(std::make_pair(ref, ref));
+    }
+    else if (expr.type_ == Expr::Range)
+    {
+      const Index start(expr.startIndex_.x + idx.x, expr.startIndex_.y + idx.y);
+      const Index end(expr.endIndex_.x + idx.x, expr.endIndex_.y + idx.y);
+
+      refs.push_back(std::make_pair(Index(std::min(start.x, end.x), std::min(start.y, end.y)),
+                                    Index(std::max(start.x, end.x), std::max(start.y, end.y))));
+    }
+  }
+}
+
+static void appendStat(Jim_Interp * interp, Jim_Obj * dict, const char * key, long long value)
+{
+  Jim_ListAppendElement(interp, dict, Jim_NewStringObj(interp, key, -1));
+  Jim_ListAppendElement(interp, dict, Jim_NewIntObj(interp, value));
+}
+
+TCL_FUNC(formulaCacheStats, "?-reset?", "Returns the hits, misses and size of the cache of parsed formulas as a dict")
+{
+  TCL_CHECK_ARGS(1, 2);
+
+  const bool reset = argc == 2;
+  if (reset && std::string(Jim_String(argv[1])) != "-reset")
+  {
+    Jim_WrongNumArgs(interp, 1, argv, "?-reset?");
+    return JIM_ERR;
+  }
+
+  const long long lookups = cacheStats_.hits + cacheStats_.misses;
+
+  Jim_Obj * dict = Jim_NewListObj(interp, nullptr, 0);
+  appendStat(interp, dict, "hits", cacheStats_.hits);
+  appendStat(interp, dict, "misses", cacheStats_.misses);
+  appendStat(interp, dict, "size", formulaCache_.size());
+  appendStat(interp, dict, "recent", std::count_if(recentFormulas_.begin(), recentFormulas_.end(), [](std::shared_ptr<const Formula> const& formula) {
+    return formula != nullptr;
+  }));
+
+  Jim_ListAppendElement(interp, dict, Jim_NewStringObj(interp, "hitRate", -1));
+  Jim_ListAppendElement(interp, dict, Jim_NewDoubleObj(interp, lookups > 0 ? (double)cacheStats_.hits / lookups : 0.0));
+
+  if (reset)
+    cacheStats_ = FormulaCacheStats();
+
+  Jim_SetResult(interp, dict);
+  return JIM_OK;
+}
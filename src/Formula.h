@@ -0,0 +1,46 @@
+
+#pragma once
+
+#include "Expression.h"
+#include "Program.h"
+#include "Index.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+
+// A parsed and compiled formula with its cell references stored as offsets from the cell
+// that holds it. Formulas are interned by this relative form, so a formula that is filled
+// down a column is only parsed and compiled once and then shared by all of its cells.
+class Formula
+{
+  public:
+    // Returns the shared formula for source, the formula text without the leading '=', in cell idx
+    static std::shared_ptr<const Formula> intern(std::string const& source, Index const& idx);
+
+    // Returns the shared formula for an expression with its references resolved for cell idx,
+    // without printing and parsing it again
+    static std::shared_ptr<const Formula> intern(std::vector<Expr> const& expression, Index const& idx);
+
+    // False if the source could not be parsed
+    bool valid() const { return !expression_.empty(); }
+
+    // The parsed expression with its references resolved for the cell at idx
+    std::vector<Expr> expression(Index const& idx) const;
+
+    double evaluate(Index const& idx) const;
+
+    // Evaluates the formula for count cells down the column from idx, see Program::executeBlock()
+    bool evaluateBlock(Index const& idx, int count, double * results) const;
+
+    // Appends the first and last cell of every reference of the formula in cell idx, a single
+    // cell is a range of one
+    void references(Index const& idx, std::vector<std::pair<Index, Index>> & refs) const;
+
+  private:
+    static std::shared_ptr<const Formula> create(std::string const& key, std::vector<Expr> const& expression, Index const& idx);
+
+    std::vector<Expr> expression_;
+    Program program_;
+};
@@ -81,21 +81,26 @@ std::string Index::toStr() const
 }
 
 Index Index::fromStr(std::string const& str)
+{
+  return fromStr(str.data(), str.size());
+}
+
+Index Index::fromStr(const char * str, std::size_t size)
 {
   Index idx(0, 0);
 
-  if (str.empty())
+  if (size == 0)
     return idx;
 
-  int i = 0;
-  while ((i < str.size()) && std::isupper(str[i]))
+  std::size_t i = 0;
+  while ((i < size) && std::isupper(str[i]))
   {
     idx.x *= 26;
     idx.x += str[i] - 'A';
     i++;
   }
 
-  while ((i < str.size()) && std::isdigit(str[i]))
+  while ((i < size) && std::isdigit(str[i]))
   {
     idx.y *= 10;
     idx.y += str[i] - '0';
@@ -18,6 +18,7 @@ class Index
     std::string toStr() const;
 
     static Index fromStr(std::string const& str);
+    static Index fromStr(const char * str, std::size_t size);
 
     static std::string rowToStr(int row);
     static std::string columnToStr(int col);
@@ -0,0 +1,61 @@
+
+#include "Perf.h"
+#include "Tcl.h"
+
+#include <bx/timer.h>
+
+namespace perf {
+
+  // Every thread keeps its own, a background recalculation copies its numbers over when it is applied
+  Stats & stats()
+  {
+    static thread_local Stats stats;
+    return stats;
+  }
+
+  int64_t now()
+  {
+    return bx::getHPCounter();
+  }
+
+  double elapsed(int64_t start)
+  {
+    return (double)(bx::getHPCounter() - start) * 1000.0 / (double)bx::getHPFrequency();
+  }
+
+  double throughput(long long bytes, double time)
+  {
+    if (time <= 0.0)
+      return 0.0;
+
+    return ((double)bytes / (1024.0 * 1024.0)) / (time / 1000.0);
+  }
+
+  static void appendValue(Jim_Interp * interp, Jim_Obj * dict, const char * key, Jim_Obj * value)
+  {
+    Jim_ListAppendElement(interp, dict, Jim_NewStringObj(interp, key, -1));
+    Jim_ListAppendElement(interp, dict, value);
+  }
+
+  TCL_FUNC(perfStats, "", "Returns timings for the last frame, recalculation, load and save as a dict")
+  {
+    TCL_CHECK_ARG(1);
+
+    Stats const& s = stats();
+    Jim_Obj * dict = Jim_NewListObj(interp, nullptr, 0);
+
+    appendValue(interp, dict, "frameTime", Jim_NewDoubleObj(interp, s.frameTime));
+    appendValue(interp, dict, "presentTime", Jim_NewDoubleObj(interp, s.presentTime));
+    appendValue(interp, dict, "recalcTime", Jim_NewDoubleObj(interp, s.recalcTime));
+    appendValue(interp, dict, "recalcCells", Jim_NewIntObj(interp, s.recalcCells));
+    appendValue(interp, dict, "loadTime", Jim_NewDoubleObj(interp, s.loadTime));
+    appendValue(interp, dict, "loadBytes", Jim_NewIntObj(interp, s.loadBytes));
+    appendValue(interp, dict, "loadThroughput", Jim_NewDoubleObj(interp, throughput(s.loadBytes, s.loadTime)));
+    appendValue(interp, dict, "saveTime", Jim_NewDoubleObj(interp, s.saveTime));
+    appendValue(interp, dict, "saveBytes", Jim_NewIntObj(interp, s.saveBytes));
+    appendValue(interp, dict, "saveThroughput", Jim_NewDoubleObj(interp, throughput(s.saveBytes, s.saveTime)));
+
+    Jim_SetResult(interp, dict);
+    return JIM_OK;
+  }
+}
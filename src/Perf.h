@@ -0,0 +1,28 @@
+
+#pragma once
+
+#include <cstdint>
+
+namespace perf {
+
+  // Timings are in milliseconds and sizes in bytes
+  struct Stats
+  {
+    double frameTime = 0.0;
+    double presentTime = 0.0;
+    double recalcTime = 0.0;
+    int recalcCells = 0;
+    double loadTime = 0.0;
+    long long loadBytes = 0;
+    double saveTime = 0.0;
+    long long saveBytes = 0;
+  };
+
+  Stats & stats();
+
+  int64_t now();
+  double elapsed(int64_t start);
+
+  // Returns throughput in megabytes per second
+  double throughput(long long bytes, double time);
+}
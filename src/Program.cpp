@@ -0,0 +1,496 @@
+
+#include "Program.h"
+#include "Aggregate.h"
+#include "ValueStore.h"
+#include "Document.h"
+#include "Log.h"
+
+#include <string.h>
+
+#include <cmath>
+#include <algorithm>
+
+static const int MAX_STACK_SIZE = 64;
+
+struct Operation
+{
+  const char * name;
+  Program::OpCode op;
+  int argCount;
+  Aggregate aggregate;  //< The reduction of a range function
+};
+
+static const Operation OPERATIONS[] = {
+  { "+",        Program::OpCode::Add,       2 },
+  { "-",        Program::OpCode::Subtract,  2 },
+  { "*",        Program::OpCode::Multiply,  2 },
+  { "/",        Program::OpCode::Divide,    2 },
+  { "SUM",      Program::OpCode::Aggregate, 1, Aggregate::Sum },
+  { "MIN",      Program::OpCode::Aggregate, 1, Aggregate::Min },
+  { "MAX",      Program::OpCode::Aggregate, 1, Aggregate::Max },
+  { "AVERAGE",  Program::OpCode::Aggregate, 1, Aggregate::Average },
+  { "COUNT",    Program::OpCode::Aggregate, 1, Aggregate::Count },
+  { "MIN",      Program::OpCode::Min,       2 },
+  { "MAX",      Program::OpCode::Max,       2 },
+  { "ABS",      Program::OpCode::Abs,       1 },
+  { "COS",      Program::OpCode::Cos,       1 },
+  { "SIN",      Program::OpCode::Sin,       1 },
+  { "FLOOR",    Program::OpCode::Floor,     1 },
+  { "CEIL",     Program::OpCode::Ceil,      1 },
+};
+
+static Operation const* findOperation(const char * name, int argCount)
+{
+  for (Operation const& operation : OPERATIONS)
+    if (operation.argCount == argCount && strcmp(operation.name, name) == 0)
+      return &operation;
+
+  return nullptr;
+}
+
+// Evaluates an operation on constant arguments while compiling, this must give the same result as execute()
+static double foldOperation(Program::OpCode op, double lhs, double rhs)
+{
+  switch (op)
+  {
+    case Program::OpCode::Add:       return lhs + rhs;
+    case Program::OpCode::Subtract:  return lhs - rhs;
+    case Program::OpCode::Multiply:  return lhs * rhs;
+    case Program::OpCode::Divide:    return lhs / rhs;
+    case Program::OpCode::Min:       return std::min(lhs, rhs);
+    case Program::OpCode::Max:       return std::max(lhs, rhs);
+    case Program::OpCode::Abs:       return std::abs(lhs);
+    case Program::OpCode::Cos:       return std::cos(lhs);
+    case Program::OpCode::Sin:       return std::sin(lhs);
+    case Program::OpCode::Floor:     return std::floor(lhs);
+    case Program::OpCode::Ceil:      return std::ceil(lhs);
+    default:                         return 0.0;
+  }
+}
+
+Program Program::compile(std::vector<Expr> const& expression, Index const& origin)
+{
+  // What is on the stack while compiling, ranges only become values when a range function consumes them
+  struct Slot
+  {
+    bool range;
+    bool constant;
+    int instruction;
+    int rangeIndex;
+  };
+
+  Program program;
+  program.compiled_ = true;
+
+  if (expression.empty())
+  {
+    program.error_ = true;
+    return program;
+  }
+
+  std::vector<Slot> stack;
+  int zeroConstant = -1;
+
+  auto error = [&](std::string const& message) -> Program {
+    std::vector<Expr> resolved = expression;
+    offsetReferences(resolved, origin.x, origin.y);
+
+    logError("error in expression '", exprToString(resolved), "' - ", message);
+    program.code_.clear();
+    program.error_ = true;
+    return program;
+  };
+
+  auto push = [&](Instruction const& instruction, bool range, int rangeIndex) {
+    stack.push_back({ range, instruction.op == OpCode::Constant && !range, (int)program.code_.size(), rangeIndex });
+    program.code_.push_back(instruction);
+  };
+
+  auto pushConstant = [&](double value) {
+    push({ OpCode::Constant, (int32_t)program.constants_.size(), 0 }, false, -1);
+    program.constants_.push_back(value);
+  };
+
+  auto constantValue = [&](Slot const& slot) {
+    return program.constants_[program.code_[slot.instruction].a];
+  };
+
+  for (auto const& expr : expression)
+  {
+    switch (expr.type_)
+    {
+      case Expr::Constant:
+        pushConstant(expr.constant_);
+        break;
+
+      case Expr::Cell:
+        push({ OpCode::Cell, expr.startIndex_.x, expr.startIndex_.y }, false, -1);
+        break;
+
+      case Expr::Range:
+        {
+          // A range used as a plain value is 0, this is patched into an aggregate if a range function consumes it
+          if (zeroConstant < 0)
+          {
+            zeroConstant = program.constants_.size();
+            program.constants_.push_back(0.0);
+          }
+
+          const int rangeIndex = program.ranges_.size();
+          program.ranges_.push_back({ expr.startIndex_.x, expr.startIndex_.y, expr.endIndex_.x, expr.endIndex_.y });
+
+          push({ OpCode::Constant, zeroConstant, 0 }, true, rangeIndex);
+        }
+        break;
+
+      case Expr::Function:
+        {
+          Operation const* operation = findOperation(expr.toStr().c_str(), expr.argCount());
+          if (!operation)
+          {
+            program.fallback_ = true;
+            return program;
+          }
+
+          if (stack.size() < operation->argCount)
+            return error("wrong number of arguments");
+
+          if (operation->op == OpCode::Aggregate)
+          {
+            Slot slot = stack.back();
+            if (!slot.range)
+              return error(std::string(operation->name) + " function expected range argument");
+
+            Range const& range = program.ranges_[slot.rangeIndex];
+            if (range.x0 > range.x1 || range.y0 > range.y1)
+              return error("invalid range, start index must be less than end index");
+
+            program.code_[slot.instruction] = { OpCode::Aggregate, slot.rangeIndex, (int32_t)operation->aggregate };
+            stack.back().range = false;
+          }
+          else
+          {
+            const Slot lhs = stack[stack.size() - operation->argCount];
+            const Slot rhs = stack.back();
+
+            bool constantArguments = true;
+            for (std::size_t i = stack.size() - operation->argCount; i < stack.size(); ++i)
+              constantArguments = constantArguments && stack[i].constant;
+
+            if (constantArguments)
+            {
+              // Every constant is a single instruction, so the arguments are the last instructions emitted
+              const double value = foldOperation(operation->op, constantValue(lhs), constantValue(rhs));
+
+              program.code_.resize(lhs.instruction);
+              stack.resize(stack.size() - operation->argCount);
+              pushConstant(value);
+            }
+            else if (operation->argCount == 2 && rhs.constant && !lhs.range &&
+                     ((operation->op == OpCode::Multiply && constantValue(rhs) == 1.0) ||
+                      (operation->op == OpCode::Divide && constantValue(rhs) == 1.0) ||
+                      (operation->op == OpCode::Subtract && constantValue(rhs) == 0.0)))
+            {
+              // x * 1, x / 1 and x - 0 are always x, so the constant is dropped
+              program.code_.pop_back();
+              stack.pop_back();
+            }
+            else if (operation->op == OpCode::Multiply && lhs.constant && !rhs.range && constantValue(lhs) == 1.0)
+            {
+              program.code_.erase(program.code_.begin() + lhs.instruction);
+              stack.resize(stack.size() - 2);
+              stack.push_back({ false, false, rhs.instruction - 1, -1 });
+            }
+            else
+            {
+              stack.resize(stack.size() - operation->argCount);
+              stack.push_back({ false, false, (int)program.code_.size(), -1 });
+              program.code_.push_back({ operation->op, 0, 0 });
+            }
+          }
+        }
+        break;
+    }
+
+    program.stackSize_ = std::max(program.stackSize_, (int)stack.size());
+
+    if (stack.size() > MAX_STACK_SIZE)
+    {
+      program.fallback_ = true;
+      return program;
+    }
+  }
+
+  if (stack.size() != 1)
+    return error("wrong number of values");
+
+  // Drop the constants that were folded away
+  std::vector<double> constants;
+  for (Instruction & instruction : program.code_)
+  {
+    if (instruction.op == OpCode::Constant)
+    {
+      constants.push_back(program.constants_[instruction.a]);
+      instruction.a = constants.size() - 1;
+    }
+  }
+  program.constants_.swap(constants);
+
+  return program;
+}
+
+static inline double readCell(ValueStore const& store, int x, int y)
+{
+  double value;
+  if (store.read(x, y, value))
+    return value;
+
+  return doc::getCellValue(Index(x, y));
+}
+
+double Program::execute(Index const& origin) const
+{
+  if (error_)
+    return 0.0;
+
+  ValueStore const& store = doc::values();
+
+  double stack[MAX_STACK_SIZE];
+  int top = 0;
+
+  for (Instruction const& instruction : code_)
+  {
+    switch (instruction.op)
+    {
+      case OpCode::Constant:
+        stack[top++] = constants_[instruction.a];
+        break;
+
+      case OpCode::Cell:
+        stack[top++] = readCell(store, origin.x + instruction.a, origin.y + instruction.b);
+        break;
+
+      case OpCode::Aggregate:
+        {
+          Range const& range = ranges_[instruction.a];
+
+          stack[top++] = aggregateRange((Aggregate)instruction.b,
+                                        Index(origin.x + range.x0, origin.y + range.y0),
+                                        Index(origin.x + range.x1, origin.y + range.y1));
+        }
+        break;
+
+      case OpCode::Add:
+        top--;
+        stack[top - 1] = stack[top - 1] + stack[top];
+        break;
+
+      case OpCode::Subtract:
+        top--;
+        stack[top - 1] = stack[top - 1] - stack[top];
+        break;
+
+      case OpCode::Multiply:
+        top--;
+        stack[top - 1] = stack[top - 1] * stack[top];
+        break;
+
+      case OpCode::Divide:
+        top--;
+        stack[top - 1] = stack[top - 1] / stack[top];
+        break;
+
+      case OpCode::Min:
+        top--;
+        stack[top - 1] = std::min(stack[top - 1], stack[top]);
+        break;
+
+      case OpCode::Max:
+        top--;
+        stack[top - 1] = std::max(stack[top - 1], stack[top]);
+        break;
+
+      case OpCode::Abs:
+        stack[top - 1] = std::abs(stack[top - 1]);
+        break;
+
+      case OpCode::Cos:
+        stack[top - 1] = std::cos(stack[top - 1]);
+        break;
+
+      case OpCode::Sin:
+        stack[top - 1] = std::sin(stack[top - 1]);
+        break;
+
+      case OpCode::Floor:
+        stack[top - 1] = std::floor(stack[top - 1]);
+        break;
+
+      case OpCode::Ceil:
+        stack[top - 1] = std::ceil(stack[top - 1]);
+        break;
+    }
+  }
+
+  return stack[0];
+}
+
+bool Program::executeBlock(Index const& origin, int count, double * results) const
+{
+  if (fallback_ || count <= 0 || count > BLOCK_SIZE)
+    return false;
+
+  if (error_)
+  {
+    std::fill(results, results + count, 0.0);
+    return true;
+  }
+
+  ValueStore const& store = doc::values();
+
+  // Each stack slot holds one value per row of the block
+  thread_local std::vector<double> stackData;
+  stackData.resize(stackSize_ * BLOCK_SIZE);
+
+  double * stack = stackData.data();
+  auto slot = [stack](int index) { return stack + index * BLOCK_SIZE; };
+
+  int top = 0;
+
+  for (Instruction const& instruction : code_)
+  {
+    switch (instruction.op)
+    {
+      case OpCode::Constant:
+        std::fill(slot(top), slot(top) + count, constants_[instruction.a]);
+        top++;
+        break;
+
+      case OpCode::Cell:
+        // Source cells that are not evaluated yet make the caller evaluate the block cell by cell
+        if (!store.readSpan(origin.x + instruction.a, origin.y + instruction.b, count, slot(top)))
+          return false;
+        top++;
+        break;
+
+      case OpCode::Aggregate:
+        {
+          Range const& range = ranges_[instruction.a];
+          double * out = slot(top);
+
+          for (int i = 0; i < count; ++i)
+          {
+            out[i] = aggregateRange((Aggregate)instruction.b,
+                                    Index(origin.x + range.x0, origin.y + i + range.y0),
+                                    Index(origin.x + range.x1, origin.y + i + range.y1));
+          }
+
+          top++;
+        }
+        break;
+
+      case OpCode::Add:
+        {
+          top--;
+          double * lhs = slot(top - 1);
+          double const* rhs = slot(top);
+          for (int i = 0; i < count; ++i)
+            lhs[i] = lhs[i] + rhs[i];
+        }
+        break;
+
+      case OpCode::Subtract:
+        {
+          top--;
+          double * lhs = slot(top - 1);
+          double const* rhs = slot(top);
+          for (int i = 0; i < count; ++i)
+            lhs[i] = lhs[i] - rhs[i];
+        }
+        break;
+
+      case OpCode::Multiply:
+        {
+          top--;
+          double * lhs = slot(top - 1);
+          double const* rhs = slot(top);
+          for (int i = 0; i < count; ++i)
+            lhs[i] = lhs[i] * rhs[i];
+        }
+        break;
+
+      case OpCode::Divide:
+        {
+          top--;
+          double * lhs = slot(top - 1);
+          double const* rhs = slot(top);
+          for (int i = 0; i < count; ++i)
+            lhs[i] = lhs[i] / rhs[i];
+        }
+        break;
+
+      case OpCode::Min:
+        {
+          top--;
+          double * lhs = slot(top - 1);
+          double const* rhs = slot(top);
+          for (int i = 0; i < count; ++i)
+            lhs[i] = std::min(lhs[i], rhs[i]);
+        }
+        break;
+
+      case OpCode::Max:
+        {
+          top--;
+          double * lhs = slot(top - 1);
+          double const* rhs = slot(top);
+          for (int i = 0; i < count; ++i)
+            lhs[i] = std::max(lhs[i], rhs[i]);
+        }
+        break;
+
+      case OpCode::Abs:
+        {
+          double * value = slot(top - 1);
+          for (int i = 0; i < count; ++i)
+            value[i] = std::abs(value[i]);
+        }
+        break;
+
+      case OpCode::Cos:
+        {
+          double * value = slot(top - 1);
+          for (int i = 0; i < count; ++i)
+            value[i] = std::cos(value[i]);
+        }
+        break;
+
+      case OpCode::Sin:
+        {
+          double * value = slot(top - 1);
+          for (int i = 0; i < count; ++i)
+            value[i] = std::sin(value[i]);
+        }
+        break;
+
+      case OpCode::Floor:
+        {
+          double * value = slot(top - 1);
+          for (int i = 0; i < count; ++i)
+            value[i] = std::floor(value[i]);
+        }
+        break;
+
+      case OpCode::Ceil:
+        {
+          double * value = slot(top - 1);
+          for (int i = 0; i < count; ++i)
+            value[i] = std::ceil(value[i]);
+        }
+        break;
+    }
+  }
+
+  std::copy(slot(0), slot(0) + count, results);
+  return true;
+}
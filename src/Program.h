@@ -0,0 +1,74 @@
+
+#pragma once
+
+#include "Expression.h"
+
+#include <vector>
+#include <cstdint>
+
+// A formula compiled from its parsed expression to a flat list of instructions that run
+// over a stack of doubles. Cell references are kept as positions and read straight from
+// the document value store, only cells that are not evaluated yet go through the document.
+// Constant subexpressions are folded while compiling, the parsed expression is left untouched.
+class Program
+{
+  public:
+    enum class OpCode : uint8_t
+    {
+      Constant,
+      Cell,
+      Aggregate,
+      Add,
+      Subtract,
+      Multiply,
+      Divide,
+      Min,
+      Max,
+      Abs,
+      Cos,
+      Sin,
+      Floor,
+      Ceil
+    };
+
+    struct Instruction
+    {
+      OpCode op;
+      int32_t a;    //< Constant or range index, or the column of a cell
+      int32_t b;    //< The row of a cell, or the reduction of an aggregate
+    };
+
+    struct Range
+    {
+      int32_t x0, y0, x1, y1;
+    };
+
+    // Cell references in the expression are offsets from origin, the same origin is then passed to execute()
+    static Program compile(std::vector<Expr> const& expression, Index const& origin = Index(0, 0));
+
+    bool compiled() const { return compiled_; }
+
+    // Expressions the compiler does not handle are evaluated with evaluate() instead
+    bool fallback() const { return fallback_; }
+
+    double execute(Index const& origin = Index(0, 0)) const;
+
+    // Number of rows executeBlock() handles at once
+    static const int BLOCK_SIZE = 256;
+
+    // Executes the program for count cells down a column starting at origin, one instruction at
+    // a time over all rows. Returns false if a referenced cell is not evaluated yet, the results
+    // are then not written and the cells have to be evaluated with execute() instead.
+    bool executeBlock(Index const& origin, int count, double * results) const;
+
+    std::vector<Instruction> const& code() const { return code_; }
+
+  private:
+    std::vector<Instruction> code_;
+    std::vector<double> constants_;
+    std::vector<Range> ranges_;
+    int stackSize_ = 0;
+    bool compiled_ = false;
+    bool fallback_ = false;
+    bool error_ = false;
+};
@@ -0,0 +1,189 @@
+
+#include "RangeTree.h"
+
+#include <algorithm>
+
+const int RangeTree::LEAF_SIZE;
+
+static RangeSummary summarizeSpan(double const* values, uint8_t const* numbers, int count)
+{
+  const double inf = std::numeric_limits<double>::infinity();
+
+  // Four independent partial sums, so the loop is not bound by the latency of a single add
+  double partial[4] = { 0.0, 0.0, 0.0, 0.0 };
+  double min = inf;
+  double max = -inf;
+  int64_t numberCount = 0;
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    partial[0] += values[i];
+    partial[1] += values[i + 1];
+    partial[2] += values[i + 2];
+    partial[3] += values[i + 3];
+  }
+
+  double sum = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+  for (; i < count; ++i)
+    sum += values[i];
+
+  for (i = 0; i < count; ++i)
+  {
+    min = std::min(min, numbers[i] ? values[i] : inf);
+    max = std::max(max, numbers[i] ? values[i] : -inf);
+    numberCount += numbers[i];
+  }
+
+  RangeSummary summary;
+  summary.sum = sum;
+  summary.min = min;
+  summary.max = max;
+  summary.count = numberCount;
+  return summary;
+}
+
+RangeSummary combine(RangeSummary const& lhs, RangeSummary const& rhs)
+{
+  RangeSummary summary;
+  summary.sum = lhs.sum + rhs.sum;
+  summary.min = std::min(lhs.min, rhs.min);
+  summary.max = std::max(lhs.max, rhs.max);
+  summary.count = lhs.count + rhs.count;
+  return summary;
+}
+
+void RangeTree::extend(double const* values, uint8_t const* numbers, int height, int rows)
+{
+  const int leafCount = (height + LEAF_SIZE - 1) / LEAF_SIZE;
+  if (leafCount != leafCount_)
+  {
+    leafCount_ = leafCount;
+    treeSize_ = 1;
+    while (treeSize_ < leafCount_)
+      treeSize_ *= 2;
+
+    nodes_.assign(treeSize_ * 2, RangeSummary());
+    validLeaves_ = 0;
+  }
+
+  const int validLeaves = rows >= height ? leafCount_ : std::min(rows / LEAF_SIZE, leafCount_);
+  if (validLeaves <= validLeaves_)
+    return;
+
+  for (int leaf = validLeaves_; leaf < validLeaves; ++leaf)
+  {
+    const int row = leaf * LEAF_SIZE;
+    nodes_[treeSize_ + leaf] = summarizeSpan(values + row, numbers + row, std::min(LEAF_SIZE, height - row));
+  }
+
+  // Only the nodes whose last block just became valid change
+  for (int size = 2; size <= treeSize_; size *= 2)
+  {
+    for (int first = validLeaves_ / size * size; first + size <= validLeaves; first += size)
+    {
+      const int node = treeSize_ / size + first / size;
+      nodes_[node] = combine(nodes_[node * 2], nodes_[node * 2 + 1]);
+    }
+  }
+
+  validLeaves_ = validLeaves;
+}
+
+void RangeTree::update(int row, double const* values, uint8_t const* numbers, int height)
+{
+  if (!valid(row))
+    return;
+
+  const int leaf = row / LEAF_SIZE;
+  const int start = leaf * LEAF_SIZE;
+  nodes_[treeSize_ + leaf] = summarizeSpan(values + start, numbers + start, std::min(LEAF_SIZE, height - start));
+
+  for (int size = 2; size <= treeSize_; size *= 2)
+  {
+    const int first = leaf & ~(size - 1);
+    if (first + size > validLeaves_)
+      break;
+
+    const int node = treeSize_ / size + first / size;
+    nodes_[node] = combine(nodes_[node * 2], nodes_[node * 2 + 1]);
+  }
+}
+
+struct Query
+{
+  double const* values;
+  uint8_t const* numbers;
+  int base;
+  int y0, y1;
+  int firstLeaf, lastLeaf;
+  int firstFull, lastFull;        //< Blocks whose rows are all inside the range
+  RangeSummary const* nodes;      //< The tree, or null to summarize every block from the values
+  int treeSize;
+  int validLeaves;
+};
+
+// Returns false if the node holds no rows of the range
+static bool queryNode(Query const& query, int first, int size, RangeSummary & summary)
+{
+  if (first > query.lastLeaf || first + size - 1 < query.firstLeaf)
+    return false;
+
+  if (query.nodes && first >= query.firstFull && first + size - 1 <= query.lastFull && first + size <= query.validLeaves)
+  {
+    summary = query.nodes[query.treeSize / size + first / size];
+    return true;
+  }
+
+  if (size == 1)
+  {
+    const int start = std::max(query.y0, first * RangeTree::LEAF_SIZE);
+    const int last = std::min(query.y1, first * RangeTree::LEAF_SIZE + RangeTree::LEAF_SIZE - 1);
+
+    summary = summarizeSpan(query.values + start - query.base, query.numbers + start - query.base, last - start + 1);
+    return true;
+  }
+
+  RangeSummary left, right;
+  const bool hasLeft = queryNode(query, first, size / 2, left);
+  const bool hasRight = queryNode(query, first + size / 2, size / 2, right);
+
+  if (hasLeft && hasRight)
+    summary = combine(left, right);
+  else
+    summary = hasLeft ? left : right;
+
+  return true;
+}
+
+RangeSummary RangeTree::query(double const* values, uint8_t const* numbers, int base, int end, int y0, int y1) const
+{
+  y0 = std::max(y0, 0);
+  y1 = std::min(y1, end - 1);
+
+  if (y1 < y0)
+    return RangeSummary();
+
+  Query query;
+  query.values = values;
+  query.numbers = numbers;
+  query.base = base;
+  query.y0 = y0;
+  query.y1 = y1;
+  query.firstLeaf = y0 / LEAF_SIZE;
+  query.lastLeaf = y1 / LEAF_SIZE;
+  query.firstFull = (y0 + LEAF_SIZE - 1) / LEAF_SIZE;
+  query.lastFull = y1 == end - 1 ? query.lastLeaf : (y1 + 1) / LEAF_SIZE - 1;
+  query.nodes = validLeaves_ > 0 && base == 0 ? nodes_.data() : nullptr;
+  query.treeSize = treeSize_;
+  query.validLeaves = validLeaves_;
+
+  // Start from the smallest aligned node holding the whole range, above it there is nothing to combine
+  int size = 1;
+  while (query.firstLeaf / size != query.lastLeaf / size)
+    size *= 2;
+
+  RangeSummary summary;
+  queryNode(query, query.firstLeaf / size * size, size, summary);
+  return summary;
+}
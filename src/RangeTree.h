@@ -0,0 +1,53 @@
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+// Aggregates of a range of cells, only cells holding numbers count towards min, max and count
+struct RangeSummary
+{
+  double sum = 0.0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+  int64_t count = 0;
+};
+
+RangeSummary combine(RangeSummary const& lhs, RangeSummary const& rhs);
+
+// Summaries of one column over blocks of LEAF_SIZE rows, arranged as a segment tree so any
+// range of rows is summarized in O(log n) and a changed row is updated in O(log n). Only a
+// leading run of blocks is valid, it grows as more of the column is evaluated, so ranges
+// that keep growing down the column, like running totals, extend the tree one block at a time.
+// The blocks of a range are always combined in the same order, aligned to the rows and not to
+// the height of the column, whether the tree is used or not, so the sum of a range never
+// depends on which path computed it.
+class RangeTree
+{
+  public:
+    static const int LEAF_SIZE = 64;
+
+    // Makes the blocks holding the first 'rows' rows of the column valid
+    void extend(double const* values, uint8_t const* numbers, int height, int rows);
+
+    // Drops the blocks from the one holding row on
+    void invalidate(int row) { validLeaves_ = std::min(validLeaves_, std::max(row, 0) / LEAF_SIZE); }
+    void clear() { validLeaves_ = 0; }
+
+    bool valid(int row) const { return row >= 0 && row / LEAF_SIZE < validLeaves_; }
+
+    // Updates the block holding row after its value has changed in the column
+    void update(int row, double const* values, uint8_t const* numbers, int height);
+
+    // Summarizes the rows [y0, y1] of a column. Row r is read from values[r - base] and rows
+    // from 'end' on are empty. The tree is only used if base is 0.
+    RangeSummary query(double const* values, uint8_t const* numbers, int base, int end, int y0, int y1) const;
+
+  private:
+    std::vector<RangeSummary> nodes_;
+    int leafCount_ = 0;
+    int treeSize_ = 0;
+    int validLeaves_ = 0;
+};
@@ -9,6 +9,8 @@
 #include <cmath>
 #include <cstring>
 #include <cstdlib>
+#include <cctype>
+#include <cerrno>
 #include <sstream>
 #include <ios>
 
@@ -23,9 +25,228 @@ namespace str {
 
   std::string fromDouble(double value)
   {
-    std::stringstream ss;
-    ss << value;
-    return ss.str();
+    char buffer[DOUBLE_BUFFER_SIZE];
+    return std::string(buffer, formatDouble(buffer, value));
+  }
+
+  // Integers are written exactly up to this size, larger numbers use the shortest form
+  static const double MAX_FORMATTED_INTEGER = 1e15;
+
+  static int formatInteger(char * buffer, long long value)
+  {
+    char digits[24];
+    int count = 0;
+    unsigned long long magnitude = value < 0 ? -(unsigned long long)value : value;
+
+    do
+    {
+      digits[count++] = '0' + magnitude % 10;
+      magnitude /= 10;
+    } while (magnitude > 0);
+
+    int length = 0;
+    if (value < 0)
+      buffer[length++] = '-';
+
+    while (count > 0)
+      buffer[length++] = digits[--count];
+
+    buffer[length] = '\0';
+    return length;
+  }
+
+  static int formatShortest(char * buffer, double value)
+  {
+    // 17 significant digits always parse back to the same double, fewer are tried first
+    for (int precision = 15; precision < 17; ++precision)
+    {
+      const int length = std::snprintf(buffer, DOUBLE_BUFFER_SIZE, "%.*g", precision, value);
+      if (std::strtod(buffer, nullptr) == value)
+        return length;
+    }
+
+    return std::snprintf(buffer, DOUBLE_BUFFER_SIZE, "%.17g", value);
+  }
+
+  // Inserts a ',' between every group of three digits before the decimal point
+  static int insertThousandsSeparators(char * buffer, int length)
+  {
+    const int start = buffer[0] == '-' ? 1 : 0;
+
+    int end = start;
+    while (end < length && buffer[end] >= '0' && buffer[end] <= '9')
+      ++end;
+
+    if (end < length && buffer[end] != '.')
+      return length;
+
+    const int separators = (end - start - 1) / 3;
+    if (separators <= 0)
+      return length;
+
+    std::memmove(buffer + end + separators, buffer + end, length - end + 1);
+
+    int to = end + separators - 1;
+    for (int from = end - 1, digits = 0; from >= start; --from)
+    {
+      buffer[to--] = buffer[from];
+      if (++digits % 3 == 0 && from > start)
+        buffer[to--] = ',';
+    }
+
+    return length + separators;
+  }
+
+  int formatDouble(char * buffer, double value, int decimals, bool thousandsSeparator)
+  {
+    int length = 0;
+
+    if (std::isnan(value))
+      length = std::snprintf(buffer, DOUBLE_BUFFER_SIZE, "nan");
+    else if (std::isinf(value))
+      length = std::snprintf(buffer, DOUBLE_BUFFER_SIZE, value < 0 ? "-inf" : "inf");
+    else if (std::fabs(value) >= MAX_FORMATTED_INTEGER)
+      length = formatShortest(buffer, value);
+    else if (decimals >= 0)
+      length = std::snprintf(buffer, DOUBLE_BUFFER_SIZE, "%.*f", std::min(decimals, 15), value);
+    else if (value == (double)(long long)value)
+      length = formatInteger(buffer, (long long)value);
+    else
+      length = formatShortest(buffer, value);
+
+    if (thousandsSeparator)
+      length = insertThousandsSeparators(buffer, length);
+
+    return length;
+  }
+
+  // Powers of ten that are exact doubles
+  static const double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  static const uint64_t MAX_EXACT_MANTISSA = 1ull << 53;
+
+  double toDouble(const char * str, std::size_t size)
+  {
+    std::size_t i = 0;
+    const bool negative = size > 0 && str[0] == '-';
+    if (size > 0 && (str[0] == '-' || str[0] == '+'))
+      ++i;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int fractionDigits = 0;
+    bool fraction = false;
+    bool simple = true;
+
+    for (; i < size; ++i)
+    {
+      const char ch = str[i];
+      if (ch == '.' && !fraction)
+      {
+        fraction = true;
+      }
+      else if (ch >= '0' && ch <= '9')
+      {
+        // Leading zeros are not significant
+        if (mantissa > 0 || ch != '0')
+          digits++;
+
+        if (digits > 19)
+        {
+          simple = false;
+          break;
+        }
+
+        mantissa = mantissa * 10 + (ch - '0');
+        fractionDigits += fraction ? 1 : 0;
+      }
+      else
+      {
+        simple = false;
+        break;
+      }
+    }
+
+    // Both the mantissa and the power of ten are exact, so a single division rounds correctly
+    if (simple && mantissa <= MAX_EXACT_MANTISSA && fractionDigits <= 22)
+    {
+      const double value = (double)mantissa / EXACT_POWERS_OF_TEN[fractionDigits];
+      return negative ? -value : value;
+    }
+
+    char buffer[64];
+    if (size < sizeof(buffer))
+    {
+      std::memcpy(buffer, str, size);
+      buffer[size] = '\0';
+      return std::strtod(buffer, nullptr);
+    }
+
+    return std::strtod(std::string(str, size).c_str(), nullptr);
+  }
+
+  static bool startsNumber(char ch)
+  {
+    switch (ch)
+    {
+      case '+': case '-': case '.':
+      case 'i': case 'I': case 'n': case 'N':
+        return true;
+
+      default:
+        return ch >= '0' && ch <= '9';
+    }
+  }
+
+  bool parseNumber(std::string const& str, double & value)
+  {
+    const char * start = str.c_str();
+    while (std::isspace((unsigned char)*start))
+      ++start;
+
+    // Most text is rejected by its first character
+    if (!startsNumber(*start))
+      return false;
+
+    const char * it = start;
+    if (*it == '-' || *it == '+')
+      ++it;
+
+    bool digits = false;
+    while (*it >= '0' && *it <= '9')
+    {
+      digits = true;
+      ++it;
+    }
+
+    if (*it == '.')
+    {
+      ++it;
+      while (*it >= '0' && *it <= '9')
+      {
+        digits = true;
+        ++it;
+      }
+    }
+
+    // Plain decimals are parsed here, exponents, hexadecimals, infinity and nan by strtod
+    if (digits && *it != 'e' && *it != 'E' && *it != 'x' && *it != 'X')
+    {
+      value = toDouble(start, it - start);
+      return true;
+    }
+
+    char * end = nullptr;
+    errno = 0;
+    const double result = std::strtod(start, &end);
+    if (end == start || errno == ERANGE)
+      return false;
+
+    value = result;
+    return true;
   }
 
   std::string stripWhitespace(std::string const& str)
@@ -61,6 +282,20 @@ namespace str {
 
     return strLen;
   }
+
+  void toUTF32(std::string const& in, std::vector<uint32_t> & out)
+  {
+    out.clear();
+    out.reserve(in.size());
+
+    const char * it = in.c_str();
+    while (*it)
+    {
+      uint32_t ch;
+      it += tb_utf8_char_to_unicode(&ch, it);
+      out.push_back(ch);
+    }
+  }
 }
 
 
@@ -8,9 +8,23 @@ namespace str {
   std::string fromInt(long long int value);
   std::string fromDouble(double value);
 
+  // Writes value to buffer, which must hold DOUBLE_BUFFER_SIZE characters, and returns the length.
+  // Without decimals the shortest text that parses back to the same double is written, numbers
+  // below 1e15 can also be written with a fixed number of decimals and thousands separators.
+  static const int DOUBLE_BUFFER_SIZE = 64;
+  int formatDouble(char * buffer, double value, int decimals = -1, bool thousandsSeparator = false);
+
+  // Parses a decimal number with an optional sign and fraction, like "-12.5", into the nearest double
+  double toDouble(const char * str, std::size_t size);
+
+  // Parses the number at the start of str like std::stod(), but returns false instead of
+  // throwing if str does not start with one
+  bool parseNumber(std::string const& str, double & value);
+
   std::string stripWhitespace(std::string const& str);
   uint32_t hash(std::string const& str);
   uint32_t toUTF32(std::string const& in, uint32_t * out, uint32_t outLen);
+  void toUTF32(std::string const& in, std::vector<uint32_t> & out);
 }
 
 class Str
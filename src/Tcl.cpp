@@ -2,6 +2,8 @@
 #include "Tcl.h"
 #include "Editor.h"
 #include "Log.h"
+#include "Trace.h"
+#include "Alloc.h"
 
 #ifndef DEBUG
 #include "ScriptingLib.tcl.h"
@@ -31,6 +33,10 @@ namespace tcl {
 
   static Jim_Interp * interpreter_ = nullptr;
 
+  // Bumped whenever a script runs or calls one of our commands, which is the only time a
+  // variable can change, see Variable::toInt()
+  static uint32_t generation_ = 1;
+
   // -- Variable --
 
   static std::vector<Variable *> & builtInVariables()
@@ -100,11 +106,14 @@ namespace tcl {
 
   int Variable::toInt() const
   {
-    long val;
-    if (Jim_GetLong(interpreter_, value(), &val) != JIM_OK)
-      return 0;
+    if (intGeneration_ != generation_)
+    {
+      long val;
+      intValue_ = Jim_GetLong(interpreter_, value(), &val) == JIM_OK ? val : 0;
+      intGeneration_ = generation_;
+    }
 
-    return val;
+    return intValue_;
   }
 
   // -- BuiltInProc --
@@ -165,6 +174,9 @@ namespace tcl {
   static int cmdProc(Jim_Interp * interp, int argc, Jim_Obj * const * argv)
   {
     BuiltInProc * cmd = static_cast<BuiltInProc *>(Jim_CmdPrivData(interp));
+    ALLOC_SCOPE(cmd->name());
+    ++generation_;
+
     return cmd->call(interp, argc, argv);
   }
 
@@ -277,6 +289,9 @@ namespace tcl {
   static int subCmdProc(Jim_Interp * interp, int argc, Jim_Obj * const * argv)
   {
     BuiltInSubProc * subCmd = static_cast<BuiltInSubProc *>(Jim_CmdPrivData(interp));
+    ALLOC_SCOPE(subCmd->name());
+    ++generation_;
+
     return subCmd->call(interp, argc, argv);
   }
 
@@ -344,6 +359,7 @@ namespace tcl {
 
     logInfo("Loading config file: ", configFile);
     Jim_EvalFileGlobal(interpreter_, configFile.c_str());
+    ++generation_;
   }
 
   void shutdown()
@@ -354,7 +370,11 @@ namespace tcl {
 
   bool evaluate(std::string const& code)
   {
+    TRACE_SCOPE("tcl::evaluate");
+
     const bool ok = Jim_EvalGlobal(interpreter_, code.c_str()) == JIM_OK;
+    ++generation_;
+
     if (!ok)
       logError(result());
 
@@ -62,6 +62,7 @@ namespace tcl {
       Variable(const char * name, int defaultValue);
       Variable(const char * name, bool defaultValue);
 
+      // Cached until a script may have changed the variable, so reading it every frame is cheap
       bool toBool() const;
       int toInt() const;
       std::string toStr() const;
@@ -74,6 +75,9 @@ namespace tcl {
     private:
       const char * name_ = nullptr;
 
+      mutable int intValue_ = 0;
+      mutable uint32_t intGeneration_ = 0;
+
       ValueType type_ = ValueType::STRING;
       union {
         const char * defaultStrValue_;
@@ -18,16 +18,34 @@ inline bool isOperator(char ch)
   }
 }
 
-Tokenizer::Tokenizer(std::string const& stream)
-  : stream_(stream),
-    value_(),
-    pos_(0)
+Tokenizer::Tokenizer(std::string const& str)
+  : Tokenizer(str.data(), str.size())
+{ }
+
+Tokenizer::Tokenizer(const char * str, uint32_t size)
+  : pos_(str),
+    end_(str + size),
+    value_(str, 0),
+    previous_(Token::Operator)
 { }
 
 Token Tokenizer::next()
 {
-  value_.clear();
+  previous_ = nextToken();
+  return previous_;
+}
+
+Token Tokenizer::error(std::string const& message)
+{
+  error_ = message;
+  value_ = TokenText(error_.data(), error_.size());
+  return Token::Error;
+}
+
+Token Tokenizer::nextToken()
+{
   eatWhitespace();
+  value_ = TokenText(pos_, 0);
 
   if (eof())
     return Token::EndOfFile;
@@ -36,10 +54,9 @@ Token Tokenizer::next()
   {
     return parseNumber();
   }
-  else if (current() == '-' && std::isdigit(peak()))
+  else if (current() == '-' && std::isdigit(peak()) && !followsValue())
   {
-    // Eat the '-'' and then parse the number
-    value_.append(1, '-');
+    // The '-' is part of the number
     return parseNumber();
   }
   else if (current() == '(')
@@ -57,10 +74,10 @@ Token Tokenizer::next()
     step();
     return Token::Comma;
   }
-  else if (isOperator(current()) && (std::isspace(peak()) || std::isalpha(peak()) || std::isdigit(peak())))
+  else if (isOperator(current()) && (std::isspace(peak()) || std::isalpha(peak()) || std::isdigit(peak()) || peak() == '('))
   {
-    value_.append(1, current());
     step();
+    endToken(value_.data);
 
     return Token::Operator;
   }
@@ -72,10 +89,7 @@ Token Tokenizer::next()
     return Token::EndOfFile;
 
   // If we get here, we have encountered an error
-  value_.append("unknown character: ")
-        .append(1, current());
-
-  return Token::Error;
+  return error(std::string("unknown character: ") + current());
 }
 
 void Tokenizer::eatWhitespace()
@@ -86,90 +100,90 @@ void Tokenizer::eatWhitespace()
 
 Token Tokenizer::parseNumber()
 {
-  value_.append(1, current());
+  const char * start = pos_;
   step();
 
   while (!eof() && std::isdigit(current()))
-  {
-    value_.append(1, current());
     step();
-  }
 
   if (current() == '.')
   {
     if (!std::isdigit(peak()))
     {
-      const std::string number = value_;
-      value_ = "expected digit but got ";
-      value_.append(1, peak())
-            .append(" in number ")
-            .append(number);
-      return Token::Error;
+      endToken(start);
+      return error(std::string("expected digit but got ") + peak() + " in number " + value_.str());
     }
     else
     {
-      value_.append(1, current());
       step();
 
       while (!eof() && std::isdigit(current()))
-      {
-        value_.append(1, current());
         step();
-      }
     }
   }
 
+  // An exponent, str::formatDouble() writes very large and small numbers this way
+  if (current() == 'e' || current() == 'E')
+  {
+    const char * exponent = pos_ + 1;
+    if (exponent < end_ && (*exponent == '+' || *exponent == '-'))
+      ++exponent;
+
+    if (exponent < end_ && std::isdigit(*exponent))
+    {
+      pos_ = exponent;
+
+      while (!eof() && std::isdigit(current()))
+        step();
+    }
+  }
+
+  endToken(start);
   return Token::Number;
 }
 
 Token Tokenizer::parseIdentifier()
 {
+  const char * start = pos_;
+
   if (std::isupper(current()))
     if (parseCell())
     {
       if (current() == ':' && std::isupper(peak()))
       {
-        value_.append(1, current());
         step();
 
         if (parseCell())
         {
+          endToken(start);
           return Token::Range;
         }
         else
         {
-          value_ = "expected range";
-          return Token::Error;
+          return error("expected range");
         }
       }
 
+      endToken(start);
       return Token::Cell;
     }
 
   while (!eof() && (std::isalpha(current()) || std::isdigit(current()) || current() == '_'))
-  {
-    value_.append(1, current());
     step();
-  }
 
+  endToken(start);
   return Token::Identifier;
 }
 
 bool Tokenizer::parseCell()
 {
   while (!eof() && std::isupper(current()))
-  {
-    value_.append(1, current());
     step();
-  }
 
   if (!eof() && std::isdigit(current()))
   {
     while (!eof() && std::isdigit(current()))
-    {
-      value_.append(1, current());
       step();
-    }
 
     return true;
   }
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 
 enum class Token
 {
@@ -17,24 +18,65 @@ enum class Token
   Error
 };
 
+// The characters of a token, pointing into the string that is tokenized
+struct TokenText
+{
+  TokenText() { }
+  TokenText(const char * data, uint32_t size) : data(data), size(size) { }
+
+  bool empty() const { return size == 0; }
+  std::string str() const { return std::string(data, size); }
+
+  // Returns the position of the first ch, or size if there is none
+  uint32_t find(char ch) const
+  {
+    uint32_t pos = 0;
+    while (pos < size && data[pos] != ch)
+      ++pos;
+    return pos;
+  }
+
+  TokenText substr(uint32_t pos, uint32_t count = UINT32_MAX) const
+  {
+    pos = pos < size ? pos : size;
+    return TokenText(data + pos, count < size - pos ? count : size - pos);
+  }
+
+  const char * data = nullptr;
+  uint32_t size = 0;
+};
+
+// Splits a formula into tokens without copying it, so the string must outlive the tokenizer
 class Tokenizer
 {
   public:
     Tokenizer(std::string const& str);
+    Tokenizer(const char * str, uint32_t size);
+    Tokenizer(std::string && str) = delete;
 
     Token next();
-    std::string const& value() const { return value_; }
 
-    bool eof() const { return pos_ >= stream_.size(); }
+    // The text of the last token, or the error message if it was an error
+    TokenText const& value() const { return value_; }
+
+    bool eof() const { return pos_ >= end_; }
 
   private:
+    Token nextToken();
     void eatWhitespace();
     Token parseNumber();
     Token parseIdentifier();
     bool parseCell();
+    Token error(std::string const& message);
+
+    // A '-' directly after a value is a subtraction and not the sign of a number
+    bool followsValue() const
+    {
+      return previous_ == Token::Number || previous_ == Token::Cell || previous_ == Token::Range || previous_ == Token::RightParenthesis;
+    }
 
-    char current() const { return stream_[pos_]; }
-    char peak() const { return pos_ < (stream_.size() - 1) ? stream_[pos_ + 1] : 0; }
+    char current() const { return pos_ < end_ ? *pos_ : 0; }
+    char peak() const { return pos_ + 1 < end_ ? pos_[1] : 0; }
 
     bool step()
     {
@@ -42,8 +84,13 @@ class Tokenizer
       return eof();
     }
 
+    // Ends the current token at the current position
+    void endToken(const char * start) { value_ = TokenText(start, pos_ - start); }
+
   private:
-    std::string stream_;
-    std::string value_;
-    uint32_t pos_;
-};
\ No newline at end of file
+    const char * pos_;
+    const char * end_;
+    TokenText value_;
+    std::string error_;
+    Token previous_;
+};
@@ -0,0 +1,156 @@
+
+#include "Trace.h"
+#include "Tcl.h"
+#include "Log.h"
+#include "Alloc.h"
+
+#include <bx/timer.h>
+#include <bx/mutex.h>
+#include <bx/os.h>
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+namespace trace {
+
+  static const uint32_t BUFFER_SIZE = 64 * 1024;
+
+  struct Event
+  {
+    const char * name;
+    int64_t start;
+    int64_t end;
+    uint64_t allocations;
+    uint64_t bytes;
+  };
+
+  struct ThreadBuffer
+  {
+    uint32_t tid = 0;
+    uint64_t written = 0;
+    std::vector<Event> events;
+    bx::Mutex mutex;
+  };
+
+  static bx::Mutex & buffersMutex()
+  {
+    static bx::Mutex mutex;
+    return mutex;
+  }
+
+  static std::vector<ThreadBuffer *> & threadBuffers()
+  {
+    static std::vector<ThreadBuffer *> buffers;
+    return buffers;
+  }
+
+  // Buffers are never freed, so spans from threads that have exited can still be dumped
+  static ThreadBuffer & threadBuffer()
+  {
+    static thread_local ThreadBuffer * buffer = nullptr;
+
+    if (!buffer)
+    {
+      buffer = new ThreadBuffer();
+      buffer->tid = bx::getTid();
+      buffer->events.resize(BUFFER_SIZE);
+
+      bx::MutexScope lock(buffersMutex());
+      threadBuffers().push_back(buffer);
+    }
+
+    return *buffer;
+  }
+
+  void record(const char * name, int64_t start, int64_t end, uint64_t allocations, uint64_t bytes)
+  {
+    ThreadBuffer & buffer = threadBuffer();
+    bx::MutexScope lock(buffer.mutex);
+
+    Event & event = buffer.events[buffer.written % BUFFER_SIZE];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.allocations = allocations;
+    event.bytes = bytes;
+
+    buffer.written++;
+  }
+
+  Span::Span(const char * name)
+    : name_(name)
+  {
+    // Create the thread buffer up front, so it is not counted as an allocation made inside the span
+    threadBuffer();
+
+    const alloc::Counters counters = alloc::threadCounters();
+    allocations_ = counters.count;
+    bytes_ = counters.bytes;
+    start_ = bx::getHPCounter();
+  }
+
+  Span::~Span()
+  {
+    const alloc::Counters counters = alloc::threadCounters();
+    record(name_, start_, bx::getHPCounter(), counters.count - allocations_, counters.bytes - bytes_);
+  }
+
+  bool dump(std::string const& filename)
+  {
+    std::ofstream file(filename.c_str());
+    if (!file.is_open())
+    {
+      logError("Could not open trace file '", filename, "'");
+      return false;
+    }
+
+    const double toMicroseconds = 1000000.0 / (double)bx::getHPFrequency();
+    bool first = true;
+
+    file << "{\"traceEvents\":[" << std::endl;
+
+    bx::MutexScope lock(buffersMutex());
+
+    for (ThreadBuffer * buffer : threadBuffers())
+    {
+      bx::MutexScope bufferLock(buffer->mutex);
+
+      const uint64_t count = std::min<uint64_t>(buffer->written, BUFFER_SIZE);
+      for (uint64_t i = buffer->written - count; i < buffer->written; ++i)
+      {
+        Event const& event = buffer->events[i % BUFFER_SIZE];
+
+        if (!first)
+          file << "," << std::endl;
+        first = false;
+
+        file << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+             << ",\"ts\":" << (long long)(event.start * toMicroseconds)
+             << ",\"dur\":" << (long long)((event.end - event.start) * toMicroseconds);
+
+#if ZUM_ALLOC_TRACKING
+        file << ",\"args\":{\"allocations\":" << event.allocations << ",\"bytes\":" << event.bytes << "}";
+#endif
+
+        file << "}";
+      }
+    }
+
+    file << std::endl << "]}" << std::endl;
+    return true;
+  }
+
+  TCL_FUNC(traceDump, "filename", "Write all recorded trace spans to a file in the Chrome trace-event format")
+  {
+    TCL_CHECK_ARG(2);
+    TCL_STRING_ARG(1, filename);
+
+#if ZUM_TRACE
+    TCL_INT_RESULT(dump(filename) ? 1 : 0);
+#else
+    Jim_SetResultString(interp, "tracing is not enabled in this build, configure with -DEnableTrace=ON", -1);
+    return JIM_ERR;
+#endif
+  }
+}
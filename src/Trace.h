@@ -0,0 +1,38 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Scoped trace spans, recorded into a ring buffer per thread and dumped as Chrome
+// trace-event JSON with the 'traceDump' command. Spans are compiled out unless the
+// build defines ZUM_TRACE. With allocation tracking enabled each span also records the
+// allocations made while it was open.
+
+namespace trace {
+
+  void record(const char * name, int64_t start, int64_t end, uint64_t allocations = 0, uint64_t bytes = 0);
+  bool dump(std::string const& filename);
+
+  class Span
+  {
+    public:
+      Span(const char * name);
+      ~Span();
+
+    private:
+      const char * name_;
+      int64_t start_;
+      uint64_t allocations_;
+      uint64_t bytes_;
+  };
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if ZUM_TRACE
+  #define TRACE_SCOPE(name) trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#else
+  #define TRACE_SCOPE(name)
+#endif
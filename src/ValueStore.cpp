@@ -0,0 +1,138 @@
+
+#include "ValueStore.h"
+
+#include <algorithm>
+
+// Ranges shorter than this many blocks are summed directly without extending the tree
+static const int MIN_TREE_BLOCKS = 4;
+
+void ValueStore::reset(int width, std::vector<int> const& columnHeights)
+{
+  columns_.resize(width);
+
+  for (int x = 0; x < width; ++x)
+  {
+    Column & column = columns_[x];
+    const int height = x < (int)columnHeights.size() ? columnHeights[x] : 0;
+
+    if (!valid_ || height != (int)column.values.size())
+    {
+      column.values.assign(height, 0.0);
+      column.numbers.assign(height, 0);
+      column.tree.clear();
+    }
+
+    column.ready.assign(height, 1);
+    column.written.assign(height, 0);
+    column.pending = 0;
+    column.firstPending = height;
+    column.updates = 0;
+  }
+
+  valid_ = true;
+}
+
+void ValueStore::clearUnwritten()
+{
+  for (int x = 0; x < (int)columns_.size(); ++x)
+  {
+    Column const& column = columns_[x];
+
+    // A cell that was removed leaves its old value behind in a column that kept its height
+    for (int y = 0; y < (int)column.written.size(); ++y)
+    {
+      if (!column.written[y])
+        set(x, y, 0.0, false);
+    }
+  }
+}
+
+void ValueStore::clear()
+{
+  columns_.clear();
+  valid_ = false;
+}
+
+bool ValueStore::readSpan(int x, int y, int count, double * values) const
+{
+  if (!valid_ || x < 0 || x >= (int)columns_.size() || y < 0)
+    return false;
+
+  Column const& column = columns_[x];
+  const int height = column.values.size();
+  const int end = std::min(y + count, height);
+
+  // Rows below the end of the column read as 0
+  int available = 0;
+  if (y < end)
+  {
+    uint8_t ready = 1;
+    for (int i = y; i < end; ++i)
+      ready &= column.ready[i];
+
+    if (!ready)
+      return false;
+
+    std::copy(column.values.begin() + y, column.values.begin() + end, values);
+    available = end - y;
+  }
+
+  std::fill(values + available, values + count, 0.0);
+  return true;
+}
+
+bool ValueStore::summarize(int x, int y0, int y1, RangeSummary & summary) const
+{
+  if (!valid_ || x < 0 || x >= (int)columns_.size() || y0 < 0)
+    return false;
+
+  Column const& column = columns_[x];
+  const int height = column.values.size();
+
+  if (column.pending > 0 && findPending(x, y0, y1 - y0 + 1) >= 0)
+    return false;
+
+  const int end = std::min(y1 + 1, height);
+  if (end - y0 >= MIN_TREE_BLOCKS * RangeTree::LEAF_SIZE)
+  {
+    const int pending = column.pending > 0 ? findPending(x, 0, end) : -1;
+    column.tree.extend(column.values.data(), column.numbers.data(), height, pending >= 0 ? pending : end);
+  }
+
+  summary = column.tree.query(column.values.data(), column.numbers.data(), 0, height, y0, y1);
+  return true;
+}
+
+void ValueStore::updateTree(Column & column, int y)
+{
+  const int height = column.values.size();
+
+  // Once most of the column has changed it is cheaper to build the tree again when it is next used
+  if (++column.updates > height / RangeTree::LEAF_SIZE)
+    column.tree.clear();
+  else
+    column.tree.update(y, column.values.data(), column.numbers.data(), height);
+}
+
+int ValueStore::findPending(int x, int y, int count) const
+{
+  if (x < 0 || x >= (int)columns_.size() || y < 0)
+    return -1;
+
+  Column const& column = columns_[x];
+  const int end = std::min(y + count, (int)column.values.size());
+
+  if (column.pending == 0)
+    return -1;
+
+  // The rows above firstPending are known to be evaluated, and if the search starts at or
+  // above it every row it passes is too, so repeated searches from the top stay cheap
+  int row = std::max(y, column.firstPending);
+  while (row < end && column.ready[row])
+    row++;
+
+  if (y <= column.firstPending)
+    column.firstPending = row;
+
+  return row < end ? row : -1;
+}
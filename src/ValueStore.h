@@ -0,0 +1,121 @@
+
+#pragma once
+
+#include "RangeTree.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// Evaluated cell values of a document kept densely per column, so formulas read the
+// cells they reference by position instead of looking them up in the cell map. Each
+// column is only as tall as its last non-empty cell, rows below that read as 0. Each row
+// also records if it holds a number, empty and text cells read as 0 but are not numbers.
+// Columns keep a range tree of their values for aggregates, see summarize().
+class ValueStore
+{
+  public:
+    // Sizes the store after the non-empty cells of a document, every row starts out as 0.
+    // A column that keeps its height keeps its values and range tree, every row with a cell
+    // will be set again and only the rows that change update the tree.
+    void reset(int width, std::vector<int> const& columnHeights);
+
+    // Sets the rows that were not written since the last reset, the rows without a cell, to 0
+    void clearUnwritten();
+
+    // Marks the store as stale, all reads take the slow path until the next reset
+    void clear();
+
+    bool valid() const { return valid_; }
+    int width() const { return columns_.size(); }
+
+    // Returns false if the value is not available yet and needs to be evaluated
+    bool read(int x, int y, double & value) const
+    {
+      if (x < 0 || x >= (int)columns_.size() || y < 0)
+        return false;
+
+      Column const& column = columns_[x];
+      if (y >= (int)column.values.size())
+      {
+        value = 0.0;
+        return valid_;
+      }
+
+      value = column.values[y];
+      return column.ready[y] != 0;
+    }
+
+    // Reads count rows of a column starting at row y, returns false if any of them is not available yet
+    bool readSpan(int x, int y, int count, double * values) const;
+
+    // Summarizes the rows [y0, y1] of a column, returns false if the store is stale or any of
+    // the rows is not evaluated yet. Long ranges extend the range tree of the column over the
+    // rows that are evaluated so far.
+    bool summarize(int x, int y0, int y1, RangeSummary & summary) const;
+
+    // Returns the first row in [y, y + count) that is not evaluated yet, or -1 if there is none
+    int findPending(int x, int y, int count) const;
+
+    void set(int x, int y, double value, bool number = true)
+    {
+      if (x < 0 || x >= (int)columns_.size() || y < 0 || y >= (int)columns_[x].values.size())
+        return;
+
+      Column & column = columns_[x];
+      const uint8_t flag = number ? 1 : 0;
+
+      column.written[y] = 1;
+
+      if (!column.ready[y])
+      {
+        column.ready[y] = 1;
+        column.pending--;
+      }
+
+      // Compared bitwise, so a NaN or a change of sign still counts as a change
+      if (std::memcmp(&column.values[y], &value, sizeof(double)) != 0 || column.numbers[y] != flag)
+      {
+        column.values[y] = value;
+        column.numbers[y] = flag;
+
+        if (column.tree.valid(y))
+          updateTree(column, y);
+      }
+    }
+
+    void setPending(int x, int y)
+    {
+      if (x < 0 || x >= (int)columns_.size() || y < 0 || y >= (int)columns_[x].values.size())
+        return;
+
+      Column & column = columns_[x];
+      column.written[y] = 1;
+
+      if (column.ready[y])
+      {
+        column.ready[y] = 0;
+        column.pending++;
+        column.firstPending = std::min(column.firstPending, y);
+        column.tree.invalidate(y);
+      }
+    }
+
+  private:
+    struct Column
+    {
+      std::vector<double> values;
+      std::vector<uint8_t> numbers;
+      std::vector<uint8_t> ready;
+      std::vector<uint8_t> written;   //< Rows set since the last reset
+      int pending = 0;                //< Rows that are not evaluated yet
+      mutable int firstPending = 0;   //< All rows above this one are evaluated
+      int updates = 0;                //< Rows of the tree updated since the last reset
+      mutable RangeTree tree;
+    };
+
+    void updateTree(Column & column, int y);
+
+    std::vector<Column> columns_;
+    bool valid_ = false;
+};
@@ -93,6 +93,7 @@ namespace view {
     COLOR_HIGHLIGHT   = 0x03,
     COLOR_TEXT        = 0x04,
     COLOR_SELECTION   = 0x05,
+    COLOR_STALE       = 0x06,
     COLOR_WHITE       = 0x08,
     COLOR_BOLD        = 0x0100,
     COLOR_UNDERLINE   = 0x0200,
@@ -122,4 +123,8 @@ namespace view {
   void present();
 
   void waitEvent(Event * event);
+
+  // Returns true if an event was available within 'timeout' milliseconds, a timeout of 0 only
+  // returns events that are already queued up.
+  bool peekEvent(Event * event, int timeout);
 }
@@ -7,6 +7,8 @@
 #include "UbuntuMono.ttf.h"
 
 #include <vector>
+#include <string.h>
+#include <bx/ringbuffer.h>
 #include <stb_truetype.h>
 #include <GLFW/glfw3.h>
 #include <sera.h>
@@ -64,7 +66,41 @@ namespace view {
   static std::vector<Glyph> _glyphCache;
   static std::vector<Cell> _cells;
 
-  static std::vector<Event> _eventQueue;
+  static const uint32_t EVENT_QUEUE_SIZE = 256;
+
+  static Event _eventQueue[EVENT_QUEUE_SIZE];
+  static bx::RingBufferControl _eventQueueControl(EVENT_QUEUE_SIZE);
+
+  static void pushEvent(Event const& event)
+  {
+    if (_eventQueueControl.reserve(1) != 1)
+    {
+      logError("Event queue is full, dropping event");
+      return;
+    }
+
+    _eventQueue[_eventQueueControl.m_current] = event;
+    _eventQueueControl.commit(1);
+  }
+
+  static bool popEvent(Event * event)
+  {
+    if (_eventQueueControl.available() == 0)
+      return false;
+
+    *event = _eventQueue[_eventQueueControl.m_read];
+    _eventQueueControl.consume(1);
+    return true;
+  }
+
+  static bool lastEventIs(EventType type)
+  {
+    if (_eventQueueControl.available() == 0)
+      return false;
+
+    const uint32_t last = (_eventQueueControl.m_current + EVENT_QUEUE_SIZE - 1) % EVENT_QUEUE_SIZE;
+    return _eventQueue[last].type == type;
+  }
 
   static bool initializeFont();
   static void initGlyph(int ch);
@@ -196,6 +232,7 @@ namespace view {
       case COLOR_HIGHLIGHT:   return sr_color(82, 139, 255);
       case COLOR_TEXT:        return sr_color(178, 186, 199);
       case COLOR_SELECTION:   return sr_color(44, 50, 60);
+      case COLOR_STALE:       return sr_color(99, 109, 131);
       case COLOR_WHITE:       return sr_color(255, 255, 255);
       default:                return sr_color(255, 255, 255);
     }
@@ -365,7 +402,7 @@ namespace view {
         k = glfwToKey(key);
 
       if (k != KEY_NONE)
-        _eventQueue.push_back(Event {EVENT_KEY, k, 0});
+        pushEvent(Event {EVENT_KEY, k, 0});
 
       _cursorBlinkVisible = true;
       _cursorBlinkTimeout = 0;
@@ -376,7 +413,7 @@ namespace view {
   {
     _cursorBlinkVisible = true;
     _cursorBlinkTimeout = 0;
-    _eventQueue.push_back(Event {EVENT_KEY, KEY_NONE, (uint32_t)codePoint});
+    pushEvent(Event {EVENT_KEY, KEY_NONE, (uint32_t)codePoint});
   }
 
   static void errorCallback(int error, const char * description)
@@ -387,10 +424,10 @@ namespace view {
   static void windowSizeCallback(GLFWwindow * window, int width, int height)
   {
     // Make sure we only add once resize event
-    if (_eventQueue.size() == 0 || _eventQueue.back().type != EVENT_RESIZE)
+    if (!lastEventIs(EVENT_RESIZE))
     {
       Event e = {EVENT_RESIZE, KEY_NONE, 0};
-      _eventQueue.push_back(e);
+      pushEvent(e);
     }
 
     _width = width / _fontAdvance;
@@ -408,22 +445,21 @@ namespace view {
   void waitEvent(Event * event)
   {
     // If we have pending events to process, we poll for new events and then return the oldest one
-    if (_eventQueue.size() > 0)
+    if (_eventQueueControl.available() > 0)
     {
       glfwPollEvents();
-      *event = _eventQueue.front();
-      _eventQueue.erase(_eventQueue.begin());
+      popEvent(event);
       return;
     }
 
-    while (_eventQueue.size() == 0)
+    while (_eventQueueControl.available() == 0)
     {
       glfwWaitEventsTimeout(0.01);
 
       if (glfwWindowShouldClose(_window))
       {
         Event e = {EVENT_QUIT, KEY_NONE, 0};
-        _eventQueue.push_back(e);
+        pushEvent(e);
       }
 
       _cursorBlinkTimeout += 10;
@@ -435,8 +471,26 @@ namespace view {
       }
     }
 
-    *event = _eventQueue.front();
-    _eventQueue.erase(_eventQueue.begin());
+    popEvent(event);
+  }
+
+  bool peekEvent(Event * event, int timeout)
+  {
+    if (_eventQueueControl.available() == 0)
+    {
+      if (timeout > 0)
+        glfwWaitEventsTimeout(timeout / 1000.0);
+      else
+        glfwPollEvents();
+
+      if (glfwWindowShouldClose(_window))
+      {
+        Event e = {EVENT_QUIT, KEY_NONE, 0};
+        pushEvent(e);
+      }
+    }
+
+    return popEvent(event);
   }
 
   static void initGlyph(int ch)
@@ -0,0 +1,234 @@
+
+#include "ViewHeadless.h"
+#include "Str.h"
+
+#include <deque>
+#include <unordered_map>
+
+namespace view {
+
+  struct HeadlessCell
+  {
+    uint32_t ch;
+    uint16_t fg;
+    uint16_t bg;
+  };
+
+  static int width_ = 0;
+  static int height_ = 0;
+  static uint16_t clearFg_ = COLOR_DEFAULT;
+  static uint16_t clearBg_ = COLOR_DEFAULT;
+
+  static std::vector<HeadlessCell> backBuffer_;
+  static std::vector<std::string> frame_;
+  static int frameCount_ = 0;
+
+  static std::deque<Event> events_;
+
+  bool init(int preferredWidth, int preferredHeight, const char * title)
+  {
+    width_ = preferredWidth;
+    height_ = preferredHeight;
+
+    backBuffer_.resize(width_ * height_);
+    frame_.assign(height_, std::string());
+    frameCount_ = 0;
+
+    clear();
+    return true;
+  }
+
+  void shutdown()
+  {
+    backBuffer_.clear();
+    frame_.clear();
+    events_.clear();
+  }
+
+  int width()
+  {
+    return width_;
+  }
+
+  int height()
+  {
+    return height_;
+  }
+
+  void setCursor(int x, int y)
+  {
+  }
+
+  void hideCursor()
+  {
+  }
+
+  void setClearAttributes(uint16_t fg, uint16_t bg)
+  {
+    clearFg_ = fg;
+    clearBg_ = bg;
+  }
+
+  void changeCell(int x, int y, uint32_t ch, uint16_t fg, uint16_t bg)
+  {
+    if (x < 0 || x >= width_ || y < 0 || y >= height_)
+      return;
+
+    backBuffer_[y * width_ + x] = { ch, fg, bg };
+  }
+
+  void clear()
+  {
+    for (auto & cell : backBuffer_)
+      cell = { ' ', clearFg_, clearBg_ };
+  }
+
+  void present()
+  {
+    for (int y = 0; y < height_; ++y)
+    {
+      Str line;
+      for (int x = 0; x < width_; ++x)
+        line.append(backBuffer_[y * width_ + x].ch);
+
+      frame_[y] = line.utf8();
+    }
+
+    frameCount_++;
+  }
+
+  void waitEvent(Event * event)
+  {
+    // Running out of events ends the session
+    if (!peekEvent(event, 0))
+    {
+      event->type = EVENT_QUIT;
+      event->key = KEY_NONE;
+      event->ch = 0;
+    }
+  }
+
+  bool peekEvent(Event * event, int timeout)
+  {
+    if (events_.empty())
+      return false;
+
+    *event = events_.front();
+    events_.pop_front();
+    return true;
+  }
+
+  namespace headless {
+
+    void pushEvent(Event const& event)
+    {
+      events_.push_back(event);
+    }
+
+    bool hasEvents()
+    {
+      return !events_.empty();
+    }
+
+    int frameCount()
+    {
+      return frameCount_;
+    }
+
+    std::vector<std::string> const& frame()
+    {
+      return frame_;
+    }
+
+    static const std::unordered_map<std::string, Keys> KEY_NAMES = {
+      { "Esc", KEY_ESC },
+      { "Enter", KEY_ENTER },
+      { "CR", KEY_ENTER },
+      { "Tab", KEY_TAB },
+      { "BS", KEY_BACKSPACE },
+      { "Del", KEY_DELETE },
+      { "Space", KEY_SPACE },
+      { "Up", KEY_ARROW_UP },
+      { "Down", KEY_ARROW_DOWN },
+      { "Left", KEY_ARROW_LEFT },
+      { "Right", KEY_ARROW_RIGHT },
+      { "Home", KEY_HOME },
+      { "End", KEY_END },
+      { "PageUp", KEY_PGUP },
+      { "PageDown", KEY_PGDN },
+      { "F1", KEY_F1 },
+      { "F2", KEY_F2 },
+      { "F3", KEY_F3 },
+      { "F4", KEY_F4 },
+      { "F5", KEY_F5 },
+      { "F6", KEY_F6 },
+      { "F7", KEY_F7 },
+      { "F8", KEY_F8 },
+      { "F9", KEY_F9 },
+      { "F10", KEY_F10 },
+      { "F11", KEY_F11 },
+      { "F12", KEY_F12 },
+    };
+
+    static Event keyEvent(Keys key, uint32_t ch)
+    {
+      Event event;
+      event.type = EVENT_KEY;
+      event.key = key;
+      event.ch = ch;
+      return event;
+    }
+
+    bool parseKeys(std::string const& keys, std::vector<Event> & events)
+    {
+      std::vector<uint32_t> chars;
+      str::toUTF32(keys, chars);
+
+      for (std::size_t i = 0; i < chars.size(); ++i)
+      {
+        const uint32_t ch = chars[i];
+
+        if (ch == '\n' || ch == '\r')
+          continue;
+
+        if (ch == ' ')
+        {
+          events.push_back(keyEvent(KEY_SPACE, 0));
+          continue;
+        }
+
+        if (ch != '<')
+        {
+          events.push_back(keyEvent(KEY_NONE, ch));
+          continue;
+        }
+
+        std::string name;
+        std::size_t end = i + 1;
+        while (end < chars.size() && chars[end] != '>' && chars[end] < 128)
+          name += (char)chars[end++];
+
+        if (end >= chars.size() || chars[end] != '>')
+          return false;
+
+        i = end;
+
+        // <lt> is a literal '<', <C-x> is control + x
+        if (name == "lt")
+          events.push_back(keyEvent(KEY_NONE, '<'));
+        else if (name.size() == 3 && name[0] == 'C' && name[1] == '-' && name[2] >= 'a' && name[2] <= 'z')
+          events.push_back(keyEvent((Keys)(KEY_CTRL_A + (name[2] - 'a')), 0));
+        else
+        {
+          auto it = KEY_NAMES.find(name);
+          if (it == KEY_NAMES.end())
+            return false;
+
+          events.push_back(keyEvent(it->second, 0));
+        }
+      }
+
+      return true;
+    }
+  }
+}
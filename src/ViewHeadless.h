@@ -0,0 +1,22 @@
+
+#pragma once
+
+#include "View.h"
+
+#include <string>
+#include <vector>
+
+// In-memory view backend, events are queued up front and every presented frame is kept as text
+namespace view { namespace headless {
+
+  void pushEvent(Event const& event);
+  bool hasEvents();
+
+  // Number of frames presented so far, and the text of the last one, one string per row
+  int frameCount();
+  std::vector<std::string> const& frame();
+
+  // Parses key notation like "dd:save file<Enter>" into events, returns false on an unknown <key>
+  bool parseKeys(std::string const& keys, std::vector<Event> & events);
+
+} }
@@ -56,16 +56,47 @@ namespace view {
     tb_present();
   }
 
-  bool peekEvent(Event * event, int timeout)
+  static bool translateEvent(struct tb_event const& tbEvent, Event * event)
   {
-    struct tb_event tbEvent;
-    int result = tb_peek_event(&tbEvent, timeout);
-    if (result)
+    switch (tbEvent.type)
     {
-      event->type = 
+      case TB_EVENT_KEY:
+        event->type = EVENT_KEY;
+        event->key = (Keys)tbEvent.key;
+        event->ch = tbEvent.ch;
+        return true;
+
+      case TB_EVENT_RESIZE:
+        event->type = EVENT_RESIZE;
+        event->key = KEY_NONE;
+        event->ch = 0;
+        return true;
+
+      default:
+        return false;
     }
+  }
+
+  void waitEvent(Event * event)
+  {
+    struct tb_event tbEvent;
+
+    while (tb_poll_event(&tbEvent) >= 0)
+      if (translateEvent(tbEvent, event))
+        return;
+
+    event->type = EVENT_QUIT;
+    event->key = KEY_NONE;
+    event->ch = 0;
+  }
+
+  bool peekEvent(Event * event, int timeout)
+  {
+    struct tb_event tbEvent;
+    if (tb_peek_event(&tbEvent, timeout) <= 0)
+      return false;
 
-    return (bool)result;
+    return translateEvent(tbEvent, event);
   }
 
-}
\ No newline at end of file
+}
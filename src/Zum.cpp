@@ -9,11 +9,20 @@
 #include "Log.h"
 #include "View.h"
 
+#include <bx/timer.h>
+
 static bool applicationRunning_ = true;
 static int timeout_ = 0;
 
 static const tcl::Variable DEFAULT_WIDTH("app_defaultWidth", 120);
 static const tcl::Variable DEFAULT_HEIGHT("app_defaultHeight", 40);
+static const tcl::Variable MAX_FRAME_RATE("app_maxFrameRate", 60);
+
+// Milliseconds spent evaluating pending cells between checks for events, see doc::evaluatePending()
+static const double EVALUATION_SLICE = 10.0;
+
+// Milliseconds between checks for a finished background recalculation, see doc::applyRecalc()
+static const int RECALC_POLL_INTERVAL = 10;
 
 TCL_FUNC(quit, "", "Quit the application")
 {
@@ -26,6 +35,44 @@ void clearTimeout()
   timeout_ = 0;
 }
 
+static void processEvent(view::Event * event)
+{
+  switch (event->type)
+  {
+    case view::EVENT_KEY:
+      handleKeyEvent(event);
+      break;
+
+    case view::EVENT_RESIZE:
+      break;
+
+    case view::EVENT_QUIT:
+      applicationRunning_ = false;
+      break;
+
+    default:
+      break;
+  }
+
+  executeEditCommands();
+}
+
+// Returns how many milliseconds are left until the next frame is allowed to be drawn
+static int timeUntilNextFrame(int64_t lastFrame)
+{
+  const int frameRate = MAX_FRAME_RATE.toInt();
+  if (frameRate <= 0)
+    return 0;
+
+  const int64_t frameTicks = bx::getHPFrequency() / frameRate;
+  const int64_t elapsed = bx::getHPCounter() - lastFrame;
+
+  if (elapsed >= frameTicks)
+    return 0;
+
+  return (int)((frameTicks - elapsed) * 1000 / bx::getHPFrequency());
+}
+
 int main(int argc, char * argv[])
 {
   clearLog();
@@ -52,35 +99,51 @@ int main(int argc, char * argv[])
   updateCursor();
   drawInterface();
 
+  int64_t lastFrame = bx::getHPCounter();
   view::Event event;
 
   logInfo("Application running...");
 
   while (applicationRunning_)
   {
-    view::waitEvent(&event);
+    // Cells left over by lazy evaluation are evaluated a slice at a time while there are no events
+    if (doc::hasPendingEvaluation())
+    {
+      if (!view::peekEvent(&event, 0))
+      {
+        if (!doc::evaluatePending(EVALUATION_SLICE))
+          drawInterface();
 
-    switch (event.type)
+        continue;
+      }
+    }
+    else if (doc::isRecalculating())
     {
-      case view::EVENT_KEY:
-        handleKeyEvent(&event);
-        break;
+      if (!view::peekEvent(&event, RECALC_POLL_INTERVAL))
+      {
+        if (doc::applyRecalc())
+          drawInterface();
 
-      case view::EVENT_RESIZE:
-        break;
+        continue;
+      }
+    }
+    else
+    {
+      view::waitEvent(&event);
+    }
 
-      case view::EVENT_QUIT:
-        applicationRunning_ = false;
-        break;
+    processEvent(&event);
 
-      default:
-        break;
-    }
+    // Handle all events that are queued up, and keep collecting events until the next
+    // frame is due, so a held down key results in one redraw per frame instead of one per event
+    while (applicationRunning_ && view::peekEvent(&event, timeUntilNextFrame(lastFrame)))
+      processEvent(&event);
 
     // Only update cursor and redraw interface when we have recievied an event
-    executeEditCommands();
+    doc::applyRecalc();
     updateCursor();
     drawInterface();
+    lastFrame = bx::getHPCounter();
   }
 
   tcl::shutdown();
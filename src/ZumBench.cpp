@@ -0,0 +1,257 @@
+
+#include "Bench.h"
+#include "Document.h"
+#include "Tcl.h"
+#include "Perf.h"
+#include "Log.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <random>
+#include <fstream>
+#include <functional>
+
+static const std::string CSV_FILE = "zum_bench.csv";
+static const std::string ZUM_FILE = "zum_bench.zum";
+
+struct Sheet
+{
+  std::string name;
+  std::string csv;
+
+  // Cell that gets edited, the term that is searched for and the filter command to run
+  Index editCell;
+  std::string editText;
+  std::string searchTerm;
+  std::string filter;
+};
+
+static std::string cellName(int x, int y)
+{
+  return Index::columnToStr(x) + std::to_string(y + 1);
+}
+
+static Sheet denseNumeric(int scale, std::mt19937 & random)
+{
+  Sheet sheet = { "denseNumeric", "", Index(0, 0), "42", "999", "filter A -gt 500" };
+
+  const int width = 20;
+  const int height = 2000 * scale;
+  std::uniform_int_distribution<int> number(0, 1000);
+
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      sheet.csv += std::to_string(number(random));
+      sheet.csv += x < width - 1 ? "," : "\n";
+    }
+  }
+
+  return sheet;
+}
+
+static Sheet sparseText(int scale, std::mt19937 & random)
+{
+  Sheet sheet = { "sparseText", "", Index(0, 0), "edited", "zum", "filter A -match a" };
+
+  static const char * words[] = { "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "zum" };
+
+  const int width = 50;
+  const int height = 2000 * scale;
+  std::uniform_int_distribution<int> fill(0, 9);
+  std::uniform_int_distribution<int> word(0, 6);
+
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      // The first column is always filled, so the document gets its full height
+      if (x == 0 || fill(random) == 0)
+        sheet.csv += words[word(random)];
+      sheet.csv += x < width - 1 ? "," : "\n";
+    }
+  }
+
+  return sheet;
+}
+
+// A column of values and a column where every cell depends on the cell above it
+static Sheet formulaChain(int scale, std::mt19937 & random)
+{
+  Sheet sheet = { "formulaChain", "", Index(0, 0), "42", "=B", "filter A -lt 50" };
+
+  const int height = 1000 * scale;
+  std::uniform_int_distribution<int> number(0, 100);
+
+  for (int y = 0; y < height; ++y)
+  {
+    sheet.csv += std::to_string(number(random)) + ",";
+    sheet.csv += y == 0 ? "=A1" : "=" + cellName(1, y - 1) + "+" + cellName(0, y);
+    sheet.csv += "\n";
+  }
+
+  return sheet;
+}
+
+// Two columns of values and columns of formulas filled down next to them
+static Sheet filledDown(int scale, std::mt19937 & random)
+{
+  Sheet sheet = { "filledDown", "", Index(0, 0), "42", "SIN", "filter A -gt 500" };
+
+  const int height = 5000 * scale;
+  std::uniform_int_distribution<int> number(0, 1000);
+
+  for (int y = 0; y < height; ++y)
+  {
+    const std::string row = std::to_string(y + 1);
+
+    sheet.csv += std::to_string(number(random)) + "," + std::to_string(number(random)) + ",";
+    sheet.csv += "=A" + row + " * B" + row + ",";
+    sheet.csv += "=C" + row + " / 2 + SIN(A" + row + ")\n";
+  }
+
+  return sheet;
+}
+
+// A block of values and a column of cells that each sum the whole block
+static Sheet wideSum(int scale, std::mt19937 & random)
+{
+  Sheet sheet = { "wideSum", "", Index(0, 0), "42", "SUM", "filter A -gt 500" };
+
+  const int width = 20;
+  const int height = 1000 * scale;
+  const int sums = 100;
+  std::uniform_int_distribution<int> number(0, 1000);
+
+  const std::string range = "=SUM(A1:" + cellName(width - 1, height - 1) + ")";
+
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+      sheet.csv += std::to_string(number(random)) + ",";
+
+    if (y < sums)
+      sheet.csv += range;
+    sheet.csv += "\n";
+  }
+
+  return sheet;
+}
+
+static bool writeFile(std::string const& filename, std::string const& data)
+{
+  std::ofstream file(filename.c_str());
+  if (!file.is_open())
+    return false;
+
+  file << data;
+  return true;
+}
+
+// Replace all open buffers with a single empty one
+static void resetBuffers()
+{
+  while (doc::getOpenBufferCount() > 1)
+    doc::close();
+  doc::close();
+}
+
+// The same scan the editor does when searching for the next match
+static int searchDocument(std::string const& term)
+{
+  int matches = 0;
+
+  for (int y = 0; y < doc::getRowCount(); ++y)
+    for (int x = 0; x < doc::getColumnCount(); ++x)
+      if (doc::getCellText(Index(x, y)).find(term) != std::string::npos)
+        matches++;
+
+  return matches;
+}
+
+static void benchSheet(bench::Suite & suite, Sheet const& sheet, int iterations)
+{
+  const std::string prefix = sheet.name + "/";
+
+  if (!writeFile(CSV_FILE, sheet.csv))
+  {
+    logError("could not write '", CSV_FILE, "'");
+    return;
+  }
+
+  suite.run(prefix + "load", iterations, [] { doc::load(CSV_FILE); }, resetBuffers);
+  suite.setBytes(perf::stats().loadBytes);
+
+  suite.run(prefix + "save", iterations, [] { doc::save(ZUM_FILE); });
+  suite.setBytes(perf::stats().saveBytes);
+
+  suite.run(prefix + "loadZum", iterations, [] { doc::load(ZUM_FILE); }, resetBuffers);
+  suite.setBytes(perf::stats().loadBytes);
+
+  suite.run(prefix + "evaluateDocument", iterations, [] { doc::evaluateDocument(); });
+
+  int edit = 0;
+  suite.run(prefix + "editCell", iterations, [&] {
+    doc::setCellText(sheet.editCell, sheet.editText + std::to_string(edit++));
+  });
+
+  suite.run(prefix + "undo", iterations, [] { doc::undo(); });
+  suite.run(prefix + "redo", iterations, [] { doc::redo(); });
+
+  const int buffer = doc::currentBufferIndex();
+  suite.run(prefix + "filter", iterations, [&] { tcl::evaluate(sheet.filter); }, [=] {
+    while (doc::getOpenBufferCount() > buffer + 1)
+    {
+      doc::jumpToBuffer(doc::getOpenBufferCount() - 1);
+      doc::close();
+    }
+    doc::jumpToBuffer(buffer);
+  });
+
+  doc::jumpToBuffer(buffer);
+  suite.run(prefix + "search", iterations, [&] { searchDocument(sheet.searchTerm); });
+
+  resetBuffers();
+}
+
+int main(int argc, char * argv[])
+{
+  bench::Options options;
+  if (!bench::parseOptions(argc, argv, options))
+    return 1;
+
+  clearLog();
+  tcl::initialize();
+  doc::createDefaultEmpty();
+
+  // Use a fixed seed, so every run benchmarks the same documents
+  std::mt19937 random(1234);
+
+  const std::vector<std::function<Sheet (int, std::mt19937 &)>> generators = {
+    denseNumeric,
+    sparseText,
+    formulaChain,
+    wideSum,
+    filledDown
+  };
+
+  bench::Suite suite("zum_bench");
+
+  for (auto const& generate : generators)
+    benchSheet(suite, generate(options.scale, random), options.iterations);
+
+  remove(CSV_FILE.c_str());
+  remove(ZUM_FILE.c_str());
+
+  tcl::shutdown();
+
+  if (!suite.write(options.output))
+  {
+    logError("could not write results to '", options.output, "'");
+    return 1;
+  }
+
+  return 0;
+}
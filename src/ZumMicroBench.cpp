@@ -0,0 +1,223 @@
+
+#include "Bench.h"
+#include "Document.h"
+#include "Expression.h"
+#include "Program.h"
+#include "Tokenizer.h"
+#include "Tcl.h"
+#include "Log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// Formulas as they are stored in cells, without the leading '='
+static const std::vector<std::string> FORMULAS = {
+  "A1",
+  "A1 + B1",
+  "A1 * 2",
+  "(A1 + B2) * C3 / 2",
+  "1 + 2 * 3 - 4 / 5",
+  "A1 * 1.05 + B1 * 0.95 - C1",
+  "SUM(A1:A100)",
+  "SUM(A1:C100) / 300",
+  "MAX(A1, B1) - MIN(A1, B1)",
+  "SUM(A1:A50) - SUM(A51:A100)",
+  "ABS(A1 - B1)",
+  "FLOOR(A1 * 1.5) + CEIL(B2 / 3)",
+  "SIN(A1) * COS(B1)",
+  "(A1 + A2 + A3 + A4 + A5 + A6 + A7 + A8) / 8",
+  "SUM(A1:A10) * 0.25 + SUM(B1:B10) * 0.75",
+  "AVERAGE(A1:C100) + COUNT(B1:B50)",
+  "MIN(A1:A100) * MAX(B1:B100)",
+};
+
+// Constants that are printed with an exponent or with all of their significant digits
+static const std::vector<double> CONSTANTS = {
+  0.00001,
+  -2.5e-10,
+  5e-324,
+  2e15,
+  1.7976931348623157e308,
+  0.1,
+  3.14159265,
+  1234567.891,
+};
+
+// Each timed run processes the corpus this many times
+static const int REPEAT = 1000;
+
+static int tokenize(std::string const& formula)
+{
+  Tokenizer tokenizer(formula);
+
+  int count = 0;
+  while (!tokenizer.eof())
+  {
+    const Token token = tokenizer.next();
+    if (token == Token::EndOfFile || token == Token::Error)
+      break;
+    count++;
+  }
+
+  return count;
+}
+
+// Returns true if printing the expression and parsing the text again gives back the same expression
+static bool roundTrips(std::vector<Expr> const& expression)
+{
+  const std::vector<Expr> parsed = parseExpression(exprToString(expression));
+  if (parsed.size() != expression.size())
+    return false;
+
+  for (std::size_t i = 0; i < parsed.size(); ++i)
+  {
+    Expr const& a = expression[i];
+    Expr const& b = parsed[i];
+
+    if (a.type_ != b.type_ || !(a.startIndex_ == b.startIndex_) || !(a.endIndex_ == b.endIndex_))
+      return false;
+
+    if (a.type_ == Expr::Constant && std::memcmp(&a.constant_, &b.constant_, sizeof(double)) != 0)
+      return false;
+
+    if (a.type_ == Expr::Function && a.func_ != b.func_)
+      return false;
+  }
+
+  return true;
+}
+
+// Formulas are saved as printed, so every formula of the corpus and every constant has to read back unchanged
+static bool checkRoundTrips()
+{
+  bool ok = true;
+
+  for (auto const& formula : FORMULAS)
+  {
+    if (!roundTrips(parseExpression(formula)))
+    {
+      logError("'", formula, "' does not parse back to the same formula once printed");
+      ok = false;
+    }
+  }
+
+  for (double constant : CONSTANTS)
+  {
+    std::vector<Expr> expression = parseExpression("A1 * 3");
+    for (auto & expr : expression)
+    {
+      if (expr.type_ == Expr::Constant)
+        expr.constant_ = constant;
+    }
+
+    if (!roundTrips(expression))
+    {
+      logError("'", exprToString(expression), "' does not parse back to the same constant once printed");
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+// Fill the cells referenced by the corpus with values
+static void createDocument()
+{
+  doc::createDefaultEmpty();
+
+  for (int y = 0; y < 100; ++y)
+    for (int x = 0; x < 3; ++x)
+      doc::setCellText(Index(x, y), std::to_string((x + 1) * (y + 1) % 97));
+}
+
+int main(int argc, char * argv[])
+{
+  bench::Options options;
+  options.iterations = 10;
+
+  if (!bench::parseOptions(argc, argv, options))
+    return 1;
+
+  clearLog();
+  tcl::initialize();
+  createDocument();
+
+  if (!checkRoundTrips())
+    return 1;
+
+  const int repeat = REPEAT * options.scale;
+  const long long items = (long long)FORMULAS.size() * repeat;
+
+  std::vector<std::vector<Expr>> expressions;
+  std::vector<Program> programs;
+  for (auto const& formula : FORMULAS)
+  {
+    expressions.push_back(parseExpression(formula));
+    programs.push_back(Program::compile(expressions.back()));
+  }
+
+  bench::Suite suite("zum_microbench");
+  volatile double sink = 0.0;
+
+  suite.run("tokenize", options.iterations, [&] {
+    for (int i = 0; i < repeat; ++i)
+      for (auto const& formula : FORMULAS)
+        sink = sink + tokenize(formula);
+  });
+  suite.setItems(items);
+
+  suite.run("parseExpression", options.iterations, [&] {
+    for (int i = 0; i < repeat; ++i)
+      for (auto const& formula : FORMULAS)
+        sink = sink + parseExpression(formula).size();
+  });
+  suite.setItems(items);
+
+  suite.run("evaluate", options.iterations, [&] {
+    for (int i = 0; i < repeat; ++i)
+      for (auto const& expression : expressions)
+        sink = sink + evaluate(expression);
+  });
+  suite.setItems(items);
+
+  suite.run("compile", options.iterations, [&] {
+    for (int i = 0; i < repeat; ++i)
+      for (auto const& expression : expressions)
+        sink = sink + Program::compile(expression).code().size();
+  });
+  suite.setItems(items);
+
+  suite.run("execute", options.iterations, [&] {
+    for (int i = 0; i < repeat; ++i)
+      for (auto const& program : programs)
+        sink = sink + program.execute();
+  });
+  suite.setItems(items);
+
+  suite.run("exprToString", options.iterations, [&] {
+    for (int i = 0; i < repeat; ++i)
+      for (auto const& expression : expressions)
+        sink = sink + exprToString(expression).size();
+  });
+  suite.setItems(items);
+
+  suite.run("parseAndEvaluate", options.iterations, [&] {
+    for (int i = 0; i < repeat; ++i)
+      for (auto const& formula : FORMULAS)
+        sink = sink + evaluate(parseExpression(formula));
+  });
+  suite.setItems(items);
+
+  tcl::shutdown();
+
+  if (!suite.write(options.output))
+  {
+    logError("could not write results to '", options.output, "'");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+
+#include "Bench.h"
+#include "Document.h"
+#include "Editor.h"
+#include "Commands.h"
+#include "Tcl.h"
+#include "Perf.h"
+#include "Log.h"
+#include "ViewHeadless.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+static bool replayRunning_ = true;
+
+TCL_FUNC(quit, "", "Quit the application")
+{
+  replayRunning_ = false;
+  return JIM_OK;
+}
+
+void clearTimeout()
+{
+}
+
+static bool readFile(std::string const& filename, std::string & data)
+{
+  std::ifstream file(filename.c_str());
+  if (!file.is_open())
+    return false;
+
+  std::stringstream stream;
+  stream << file.rdbuf();
+  data = stream.str();
+  return true;
+}
+
+// Lines starting with # are comments, line breaks are ignored
+static std::string stripComments(std::string const& script)
+{
+  std::string result;
+  std::istringstream stream(script);
+  std::string line;
+
+  while (std::getline(stream, line))
+  {
+    if (!line.empty() && line[0] == '#')
+      continue;
+    result += line;
+  }
+
+  return result;
+}
+
+static void writeFrame(FILE * file, int event)
+{
+  fprintf(file, "-- frame %d\n", event);
+  for (auto const& line : view::headless::frame())
+    fprintf(file, "%s\n", line.c_str());
+}
+
+static void usage(const char * name)
+{
+  fprintf(stderr, "usage: %s [-o results.json] [-f frames.txt] [-w width] [-h height] script [document ...]\n", name);
+}
+
+int main(int argc, char * argv[])
+{
+  std::string output = "-";
+  std::string framesFile;
+  std::string scriptFile;
+  std::vector<std::string> documents;
+  int width = 120;
+  int height = 40;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const bool hasValue = i + 1 < argc;
+
+    if (strcmp(argv[i], "-o") == 0 && hasValue)
+      output = argv[++i];
+    else if (strcmp(argv[i], "-f") == 0 && hasValue)
+      framesFile = argv[++i];
+    else if (strcmp(argv[i], "-w") == 0 && hasValue)
+      width = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-h") == 0 && hasValue)
+      height = atoi(argv[++i]);
+    else if (argv[i][0] == '-')
+    {
+      usage(argv[0]);
+      return 1;
+    }
+    else if (scriptFile.empty())
+      scriptFile = argv[i];
+    else
+      documents.push_back(argv[i]);
+  }
+
+  if (scriptFile.empty() || width <= 0 || height <= 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::string script;
+  if (!readFile(scriptFile, script))
+  {
+    logError("could not read script '", scriptFile, "'");
+    return 1;
+  }
+
+  std::vector<view::Event> events;
+  if (!view::headless::parseKeys(stripComments(script), events))
+  {
+    logError("unknown key in script '", scriptFile, "'");
+    return 1;
+  }
+
+  clearLog();
+  tcl::initialize();
+  view::init(width, height, "Zum");
+
+  for (auto const& document : documents)
+    doc::load(document);
+
+  if (doc::getOpenBufferCount() == 0)
+    doc::createDefaultEmpty();
+
+  FILE * frames = nullptr;
+  if (!framesFile.empty())
+  {
+    frames = fopen(framesFile.c_str(), "w");
+    if (!frames)
+    {
+      logError("could not write frames to '", framesFile, "'");
+      return 1;
+    }
+  }
+
+  updateCursor();
+  drawInterface();
+
+  if (frames)
+    writeFrame(frames, 0);
+
+  for (auto const& event : events)
+    view::headless::pushEvent(event);
+
+  std::vector<double> handleTimes;
+  std::vector<double> drawTimes;
+  std::vector<double> keyTimes;
+  uint64_t handleAllocations = 0;
+  uint64_t drawAllocations = 0;
+
+  view::Event event;
+
+  while (replayRunning_ && view::headless::hasEvents())
+  {
+    view::waitEvent(&event);
+
+    const uint64_t handleAllocationStart = bench::allocationCount();
+    const int64_t handleStart = perf::now();
+
+    handleKeyEvent(&event);
+    executeEditCommands();
+
+    const double handleTime = perf::elapsed(handleStart);
+    handleAllocations += bench::allocationCount() - handleAllocationStart;
+
+    const uint64_t drawAllocationStart = bench::allocationCount();
+    const int64_t drawStart = perf::now();
+
+    updateCursor();
+    drawInterface();
+
+    const double drawTime = perf::elapsed(drawStart);
+    drawAllocations += bench::allocationCount() - drawAllocationStart;
+
+    handleTimes.push_back(handleTime);
+    drawTimes.push_back(drawTime);
+    keyTimes.push_back(handleTime + drawTime);
+
+    if (frames)
+      writeFrame(frames, view::headless::frameCount() - 1);
+  }
+
+  if (frames)
+    fclose(frames);
+
+  bench::Suite suite("zum_replay");
+  suite.add("handleKeyEvent", handleTimes, handleAllocations);
+  suite.add("drawInterface", drawTimes, drawAllocations);
+  suite.add("keystroke", keyTimes, handleAllocations + drawAllocations);
+
+  tcl::shutdown();
+  view::shutdown();
+
+  if (!suite.write(output))
+  {
+    logError("could not write results to '", output, "'");
+    return 1;
+  }
+
+  return 0;
+}